@@ -26,7 +26,6 @@
  *******************************************************************************************************/
 
 #include "DkSkewEstimator.h"
-#include "DkImageStorage.h"
 
 #include <QDebug>
 
@@ -57,7 +56,9 @@ DkSkewEstimator::~DkSkewEstimator() {
 
 void DkSkewEstimator::setImage(QImage inImage) {
 
-	matImg = nmc::DkImage::qImage2Mat(inImage);
+	// read-only view on the image pixels
+	imgView = DkMatView(inImage);
+	matImg = imgView.mat();
 	
 	sepDims = QSize(qRound(inImage.width()/1430.0*49.0),qRound(inImage.height()/700.0*12.0));
 	delta = qRound(inImage.width()/1430.0*20.0);
@@ -49,6 +49,7 @@
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 
+#include "DkImageBridge.h"
 #endif
 
 
@@ -93,6 +94,7 @@ private:
 	
 	QVector<QVector4D> selectedLines;
 	QVector<int> selectedLineTypes;
+	DkMatView imgView;	// keeps the pixels of matImg alive
 	cv::Mat matImg;
 	int rotationFactor;
 	QProgressDialog* progress;
@@ -47,8 +47,12 @@ namespace nmc {
 			//this is optional; markus says it makes the grayscale image nicer
 			qImg = DkImage::grayscaleImage(qImg);
 
-			img = DkImage::qImage2Mat(qImg);
-			cv::cvtColor(img, img, CV_RGB2GRAY);
+			// the view reads qImg's pixels, cvtColor makes the only copy
+			nmp::DkMatView view(qImg);
+			if (view.mat().channels() > 1)
+				cv::cvtColor(view.mat(), img, CV_RGB2GRAY);
+			else
+				img = view.mat().clone();
 
 			updateThumbnail();
 			QFileInfo fi(file);
@@ -116,7 +120,7 @@ namespace nmc {
 		cv::Mat imgTinted;
 		cv::merge(channels, 3, imgTinted);
 
-		QImage qimg = DkImage::mat2QImage(imgTinted);
+		QImage qimg = nmp::DkImageBridge::toQImage(imgTinted);
 		QPixmap pxm = QPixmap::fromImage(qimg);
 		thumbnail->setIcon(pxm);
 	}
@@ -28,6 +28,7 @@
 
 #include "DkImageStorage.h"
 #include "DkBasicLoader.h"
+#include "DkImageBridge.h"
 
 namespace nmc {
 
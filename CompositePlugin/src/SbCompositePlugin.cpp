@@ -188,7 +188,7 @@ QImage SbCompositePlugin::buildComposite() const
 		cv::Mat bgra[4] = { channels[2], channels[1], channels[0], alpha };	//when merging 4 channels, blue and red are reversed again.. why..
 		cv::merge(bgra, 4, composite);
 	}
-	return DkImage::mat2QImage(composite);
+	return nmp::DkImageBridge::toQImage(composite);
 }
 
 void SbCompositePlugin::onImageChanged(int c) {
@@ -217,12 +217,13 @@ void SbCompositePlugin::onNewAlpha(QImage _alpha)
 	}
 	else {
 		qDebug() << "got full alpha";
-		alpha = DkImage::qImage2Mat(_alpha);
-		//currently it seems like qImage2Mat converts a single-channel QImage to a multi-channel Mat. so..
-		if (alpha.channels() == 4)
-			cv::cvtColor(alpha, alpha, CV_RGBA2GRAY);
-		else if (alpha.channels() == 3)
-			cv::cvtColor(alpha, alpha, CV_RGB2GRAY);
+		nmp::DkMatView view(_alpha);
+		if (view.mat().channels() == 4)
+			cv::cvtColor(view.mat(), alpha, CV_RGBA2GRAY);
+		else if (view.mat().channels() == 3)
+			cv::cvtColor(view.mat(), alpha, CV_RGB2GRAY);
+		else
+			alpha = view.mat().clone();	// we keep the alpha - so it has to own its pixels
 	}
 }
 
@@ -231,7 +232,8 @@ void SbCompositePlugin::onViewportGotImage()
 	//put that image into the three channels
 	QSharedPointer<DkImageContainerT> imgC = viewport->getImgC();
 	QImage newImage = imgC->image();
-	cv::Mat rgb = DkImage::qImage2Mat(newImage);
+	nmp::DkMatView view(newImage);
+	const cv::Mat& rgb = view.mat();	// split copies the channels - so we just need a view
 	if (rgb.channels() >= 3) {
 		std::vector<cv::Mat> c;
 		split(rgb, c);
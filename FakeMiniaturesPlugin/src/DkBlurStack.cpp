@@ -0,0 +1,266 @@
+/*******************************************************************************************************
+ DkBlurStack.cpp
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#ifdef WITH_OPENCV
+
+#include "DkBlurStack.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+ * Computes the blur stack of src.
+ * @param src the image (CV_8UC1 - CV_8UC4), it is not copied and must not change
+ * @param maxKernel the maximal kernel size (the radius of the last level is maxKernel/2)
+ * @param numLevels number of levels including the source
+ **/
+void DkBlurStack::setImage(const cv::Mat& src, int maxKernel, int numLevels) {
+
+	mSrc = src;
+	mMaxKernel = maxKernel;
+	mLevels.clear();
+	mRadii.clear();
+
+	mLevels << src;
+	mRadii << 0;
+
+	// blurPanTilt never blurs with a radius < 2
+	int maxRadius = qMax(qRound(maxKernel * 0.5), 2);
+	int numBlurred = qMax(numLevels - 1, 1);
+
+	for (int idx = 0; idx < numBlurred; idx++) {
+
+		double a = numBlurred > 1 ? (double)idx / (numBlurred - 1) : 1.0;
+		int r = qRound(2.0 * std::pow(maxRadius / 2.0, a));
+
+		if (r <= mRadii.last())
+			continue;
+
+		if (isCanceled()) {
+			mLevels.clear();
+			mRadii.clear();
+			return;
+		}
+
+		cv::Mat level;
+		boxBlur(src, level, r);
+		mLevels << level;
+		mRadii << r;
+	}
+}
+
+/**
+ * Blurs the image depending on the mask.
+ * The radius of a pixel is the same as in blurPanTilt (depth*maxKernel/2).
+ * @param mask the focus mask
+ * @return the blurred image
+ **/
+cv::Mat DkBlurStack::render(const DkFocusMask& mask) const {
+
+	if (mSrc.empty() || mLevels.empty())
+		return cv::Mat();
+
+	cv::Mat blurImg(mSrc.size(), mSrc.type());
+
+	DkFocusMask depthMask(mask);
+	depthMask.setImageSize(QSize(mSrc.cols, mSrc.rows));
+
+	const int cn = mSrc.channels();
+	const int numLevels = mLevels.size();
+	const float maxRadius = (float)mRadii.last();
+
+	cv::parallel_for_(cv::Range(0, mSrc.rows), [&](const cv::Range& range) {
+
+		std::vector<float> depth(mSrc.cols);
+		std::vector<const unsigned char*> lPtrs(numLevels);
+
+		for (int rIdx = range.start; rIdx < range.end && !isCanceled(); rIdx++) {
+
+			depthMask.depthRow(rIdx, depth.data());
+			unsigned char* blurPtr = blurImg.ptr<unsigned char>(rIdx);
+
+			for (int lIdx = 0; lIdx < numLevels; lIdx++)
+				lPtrs[lIdx] = mLevels[lIdx].ptr<unsigned char>(rIdx);
+
+			int lIdx = 0;
+
+			for (int cIdx = 0; cIdx < mSrc.cols; cIdx++) {
+
+				// same radius as blurPanTilt, but continuous
+				float r = depth[cIdx] * mMaxKernel * 0.5f;
+				if (r > 0)
+					r = qMin(qMax(r, 2.0f), maxRadius);
+
+				// the depth changes smoothly - start the search at the last level
+				while (lIdx > 0 && r < mRadii[lIdx])
+					lIdx--;
+				while (lIdx < numLevels-2 && r > mRadii[lIdx+1])
+					lIdx++;
+
+				const unsigned char* aPx = lPtrs[lIdx] + cIdx*cn;
+				unsigned char* bPx = blurPtr + cIdx*cn;
+
+				if (r <= mRadii[lIdx] || numLevels < 2) {
+					for (int c = 0; c < cn; c++)
+						bPx[c] = aPx[c];
+					continue;
+				}
+
+				const unsigned char* nPx = lPtrs[lIdx+1] + cIdx*cn;
+				float t = (r - mRadii[lIdx]) / (mRadii[lIdx+1] - mRadii[lIdx]);
+
+				for (int c = 0; c < cn; c++)
+					bPx[c] = (unsigned char)(aPx[c] + (nPx[c] - aPx[c]) * t + 0.5f);
+			}
+		}
+	});
+
+	if (isCanceled())
+		return cv::Mat();
+
+	return blurImg;
+}
+
+/**
+ * The stack stops computing as soon as cancel is set (render then returns an empty image).
+ * @param cancel the flag, it must live as long as the stack is used
+ **/
+void DkBlurStack::setCancelFlag(const QAtomicInt* cancel) {
+	mCancel = cancel;
+}
+
+bool DkBlurStack::isCanceled() const {
+	return mCancel && mCancel->load();
+}
+
+int DkBlurStack::maxKernel() const {
+	return mMaxKernel;
+}
+
+QVector<int> DkBlurStack::radii() const {
+	return mRadii;
+}
+
+/**
+ * Box blur with a (2*radius+1)^2 kernel that is clipped at the image borders (like blurPanTilt).
+ * Rows are processed in parallel bands. Every band keeps the column sums of its vertical
+ * window and updates them with one row add and one row subtract (vectorized loops).
+ * A running sum over the column sums then yields the horizontal window.
+ * @param src the image (CV_8UC1 - CV_8UC4)
+ * @param dst the blurred image
+ * @param radius the box radius
+ **/
+void DkBlurStack::boxBlur(const cv::Mat& src, cv::Mat& dst, int radius) {
+
+	dst.create(src.size(), src.type());
+
+	const int cn = src.channels();
+	const int rowElems = src.cols*cn;
+	const int rows = src.rows;
+	const int cols = src.cols;
+
+	// a few bands per thread - each band pays the initial column sums once
+	const int numBands = qMin(qMax(cv::getNumThreads() * 4, 1), qMax(rows, 1));
+
+	cv::parallel_for_(cv::Range(0, numBands), [&](const cv::Range& range) {
+
+		std::vector<unsigned int> colSum(rowElems);
+		std::vector<float> invWidth(cols);
+
+		for (int cIdx = 0; cIdx < cols; cIdx++)
+			invWidth[cIdx] = 1.0f / (qMin(cIdx + radius, cols-1) - qMax(cIdx - radius, 0) + 1);
+
+		for (int bIdx = range.start; bIdx < range.end; bIdx++) {
+
+			const int start = (int)((long long)rows * bIdx / numBands);
+			const int end = (int)((long long)rows * (bIdx+1) / numBands);
+
+			if (start >= end)
+				continue;
+
+			// initial vertical window of the band's first row
+			std::fill(colSum.begin(), colSum.end(), 0u);
+			for (int rIdx = qMax(start - radius, 0); rIdx <= qMin(start + radius, rows-1); rIdx++) {
+
+				const unsigned char* sPtr = src.ptr<unsigned char>(rIdx);
+				for (int idx = 0; idx < rowElems; idx++)
+					colSum[idx] += sPtr[idx];
+			}
+
+			for (int rIdx = start; rIdx < end; rIdx++) {
+
+				if (rIdx > start) {
+
+					if (rIdx + radius < rows) {
+						const unsigned char* addPtr = src.ptr<unsigned char>(rIdx + radius);
+						for (int idx = 0; idx < rowElems; idx++)
+							colSum[idx] += addPtr[idx];
+					}
+
+					if (rIdx - radius - 1 >= 0) {
+						const unsigned char* subPtr = src.ptr<unsigned char>(rIdx - radius - 1);
+						for (int idx = 0; idx < rowElems; idx++)
+							colSum[idx] -= subPtr[idx];
+					}
+				}
+
+				const float invHeight = 1.0f / (qMin(rIdx + radius, rows-1) - qMax(rIdx - radius, 0) + 1);
+				unsigned char* dPtr = dst.ptr<unsigned char>(rIdx);
+
+				for (int c = 0; c < cn; c++) {
+
+					// horizontal running sum of channel c
+					unsigned int sum = 0;
+					for (int x = 0; x <= qMin(radius, cols-1); x++)
+						sum += colSum[x*cn + c];
+
+					for (int cIdx = 0; cIdx < cols; cIdx++) {
+
+						if (cIdx > 0) {
+							if (cIdx + radius < cols)
+								sum += colSum[(cIdx + radius)*cn + c];
+							if (cIdx - radius - 1 >= 0)
+								sum -= colSum[(cIdx - radius - 1)*cn + c];
+						}
+
+						dPtr[cIdx*cn + c] = (unsigned char)(sum * invWidth[cIdx] * invHeight + 0.5f);
+					}
+				}
+			}
+		}
+	});
+}
+
+};
+
+#endif
@@ -0,0 +1,75 @@
+/*******************************************************************************************************
+ DkBlurStack.h
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#ifdef WITH_OPENCV
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QVector>
+#include <QAtomicInt>
+
+#include "opencv2/core/core.hpp"
+#pragma warning(pop)		// no warnings from includes - end
+
+#include "DkFocusMask.h"
+
+namespace nmp {
+
+/**
+ * Variable blur engine that precomputes a small stack of box blurred images.
+ * The radii of the levels grow geometrically from 2 to maxKernel/2, level 0 is the source.
+ * Each pixel then interpolates linearly between the two levels that enclose its radius.
+ * Contrary to blurPanTilt, which reads four far apart integral rows per pixel, all passes
+ * stream through the rows - the cost does not depend on the kernel size.
+ * The mask can be changed without recomputing the stack.
+ **/
+class DkBlurStack {
+
+public:
+	void setImage(const cv::Mat& src, int maxKernel, int numLevels = 6);
+	cv::Mat render(const DkFocusMask& mask) const;
+	void setCancelFlag(const QAtomicInt* cancel);
+
+	int maxKernel() const;
+	QVector<int> radii() const;
+
+	static void boxBlur(const cv::Mat& src, cv::Mat& dst, int radius);
+
+protected:
+	cv::Mat mSrc;
+	int mMaxKernel = 0;
+
+	QVector<cv::Mat> mLevels;	// mLevels[0] is mSrc
+	QVector<int> mRadii;
+
+	const QAtomicInt* mCancel = 0;	// stops setImage and render if it is set
+	bool isCanceled() const;
+};
+
+};
+
+#endif
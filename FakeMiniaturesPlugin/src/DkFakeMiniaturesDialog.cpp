@@ -27,6 +27,11 @@
 
 #include "DkFakeMiniaturesDialog.h"
 
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QApplication>
+#include <QtConcurrentRun>
+#pragma warning(pop)		// no warnings from includes - end
+
 #define INIT_X 0
 #define INIT_Y 0.7117
 #define INIT_WIDTH 1
@@ -34,16 +39,6 @@
 
 namespace nmp {
 
-
-#ifdef WITH_OPENCV
-	// I know - but I just want to get rid of these little issues...
-#if (CV_MAJOR_VERSION > 3)
-	int DIST_C = cv::DIST_C;
-#else
-	int DIST_C = CV_DIST_C;
-#endif
-#endif
-
 /**************************************************************
 * DkFakeMiniaturesDialog: Dialog for creating fake miniatures
 ***************************************************************/
@@ -54,6 +49,10 @@ DkFakeMiniaturesDialog::DkFakeMiniaturesDialog(QWidget* parent, Qt::WindowFlags
 
 DkFakeMiniaturesDialog::~DkFakeMiniaturesDialog() {
 
+	// nobody needs the speculative render anymore - and it must not outlive the plugin library
+	mRenderWatcher.disconnect(this);
+	cancelRender();
+	mRenderWatcher.waitForFinished();
 }
 
 /**
@@ -72,6 +71,15 @@ void DkFakeMiniaturesDialog::init() {
 	setWindowTitle(tr("Fake Miniatures"));
 	setFixedSize(dialogWidth, dialogHeight);
 	createLayout();
+
+	// the full resolution image is rendered once the user stops interacting
+	mRenderTimer = new QTimer(this);
+	mRenderTimer->setSingleShot(true);
+	mRenderTimer->setInterval(400);
+	connect(mRenderTimer, SIGNAL(timeout()), this, SLOT(startRender()));
+
+	// parameters changed while rendering -> render again
+	connect(&mRenderWatcher, SIGNAL(finished()), this, SLOT(startRender()));
 }
 
 /**
@@ -96,11 +104,26 @@ void DkFakeMiniaturesDialog::createLayout() {
 
 	kernelSizeWidget = new DkKernelSize(eastWidget, this);
 	saturationWidget = new DkSaturation(eastWidget, this);
+	tiltWidget = new DkTilt(eastWidget, this);
+	tiltWidget->setEnabled(false);
+
+	// focus mask
+	maskShapeBox = new QComboBox(eastWidget);
+	for (int idx = 0; idx < DkFocusMask::mask_end; idx++)
+		maskShapeBox->addItem(DkFocusMask::shapeName((DkFocusMask::Shape)idx));
+	connect(maskShapeBox, SIGNAL(currentIndexChanged(int)), this, SLOT(maskShapeChanged(int)));
+
+	QHBoxLayout* maskLayout = new QHBoxLayout();
+	maskLayout->setContentsMargins(10, 0, 0, 0);
+	maskLayout->addWidget(new QLabel(tr("Focus"), eastWidget));
+	maskLayout->addWidget(maskShapeBox);
 	 
 	toolsLayout->addWidget(kernelSizeWidget);
 	toolsLayout->addWidget(saturationWidget);
+	toolsLayout->addLayout(maskLayout);
+	toolsLayout->addWidget(tiltWidget);
 
-	QSpacerItem* spacer = new QSpacerItem(20,280, QSizePolicy::Minimum, QSizePolicy::Minimum);
+	QSpacerItem* spacer = new QSpacerItem(20,100, QSizePolicy::Minimum, QSizePolicy::Minimum);
 	toolsLayout->addItem(spacer);
 
 	// bottom widget - buttons	
@@ -170,7 +193,11 @@ void DkFakeMiniaturesDialog::createImgPreview() {
 	if(rMin < 1) scaledImg = mImg->scaled(imgSizeScaled, Qt::KeepAspectRatio, Qt::SmoothTransformation);
 	else scaledImg = *mImg;
 	
-	imgPreview = applyMiniaturesFilter(scaledImg, QRect(
+#ifdef WITH_OPENCV
+	mPreview.setImage(scaledImg);
+#endif
+
+	imgPreview = renderPreview(QRect(
 		INIT_X, 
 		qRound(INIT_Y*scaledImg.height()), 
 		INIT_WIDTH*scaledImg.width(), 
@@ -179,6 +206,50 @@ void DkFakeMiniaturesDialog::createImgPreview() {
 	previewLabel->setImgRect(previewImgRect);
 }
 
+/**
+ * renders the preview image - the kernel size is scaled to the preview size
+ * @param roi the rectangle that will not be blurred (preview coordinates)
+ * @return the filtered preview image
+ **/
+QImage DkFakeMiniaturesDialog::renderPreview(const QRect& roi) {
+
+#ifdef WITH_OPENCV
+	double diagO = sqrt(mImg->width()*mImg->width()+mImg->height()*mImg->height());
+	double diagP = sqrt(scaledImg.width()*scaledImg.width()+scaledImg.height()*scaledImg.height());
+	int kernelSize = qRound(kernelSizeWidget->getToolValue()*diagP/diagO);
+
+	return mPreview.render(DkFocusMask(roi, maskShape(), tilt()), kernelSize, saturationWidget->getToolValue());
+#else
+	return applyMiniaturesFilter(scaledImg, roi);
+#endif
+}
+
+/**
+ * the focus mask selected by the user
+ **/
+DkFocusMask::Shape DkFakeMiniaturesDialog::maskShape() const {
+
+	return (DkFocusMask::Shape)qMax(maskShapeBox->currentIndex(), 0);
+}
+
+/**
+ * the tilt of the focus mask in degree
+ **/
+int DkFakeMiniaturesDialog::tilt() const {
+
+	return tiltWidget->getToolValue();
+}
+
+/**
+ * the rectangle mask cannot be tilted
+ **/
+void DkFakeMiniaturesDialog::maskShapeChanged(int idx) {
+
+	tiltWidget->setEnabled(idx != DkFocusMask::mask_rect);
+	previewLabel->update();
+	redrawImgPreview();
+}
+
 /**
  * draws preview image onto preview label
  **/
@@ -202,156 +273,16 @@ void DkFakeMiniaturesDialog::drawImgPreview() {
  **/
 QImage DkFakeMiniaturesDialog::applyMiniaturesFilter(QImage inImg, QRect qRoi) {
 
-#ifdef WITH_OPENCV	
-
-	int kernelSize = kernelSizeWidget->getToolValue();
-	if (inImg == scaledImg) {
-		double diagO = sqrt(mImg->width()*mImg->width()+mImg->height()*mImg->height());
-		double diagP = sqrt(scaledImg.width()*scaledImg.width()+scaledImg.height()*scaledImg.height());
-		kernelSize = qRound(kernelSize*diagP/diagO);
-	}
-
-	int saturation = saturationWidget->getToolValue();
-	float satFactor = saturation/50.0f + 1; 
-
-	cv::Mat blurImg = DkFakeMiniaturesDialog::qImage2Mat(inImg);
-	cv::Mat distImg(blurImg.size(), CV_8UC1);
-	distImg = 255;
-	cv::Mat roi(distImg, Rect(qRoi.topLeft().x(), qRoi.topLeft().y(), qRoi.width(), qRoi.height()));
-	roi.setTo(0);
-	// blur plane by plane
-	std::vector<cv::Mat> planes;
-	cv::split(blurImg, planes);
-
-	// dist image based on 'some' threshold
-	//cv::Mat distImg;
-	//cv::threshold(planes.at(0), distImg, 40, 255, THRESH_BINARY);
+	DkMiniaturesParams params;
+	params.roi = qRoi;
+	params.shape = maskShape();
+	params.angle = tilt();
+	params.kernelSize = kernelSizeWidget->getToolValue();
+	params.saturation = saturationWidget->getToolValue();
 
-	cv::distanceTransform(distImg, distImg, DIST_C, 3);
-	cv::normalize(distImg, distImg, 1.0f, 0.0f, NORM_MINMAX);
-	
-	for (size_t idx = 0; idx < planes.size(); idx++)
-		planes.at(idx) = blurPanTilt(planes.at(idx), distImg, kernelSize);		// 140 is the maximal blurring kernel size
-		//planes.at(idx) = distImg;
-
-	cv::merge(planes, blurImg);
-	//return (DkFakeMiniaturesDialog::mat2QImage(blurImg));
-
-	if(satFactor > 1) {
-		Mat imgHsv;
-		cvtColor(blurImg, imgHsv, cv::COLOR_RGB2HSV);
-		std::vector<Mat> imgHsvCh;
-		split(imgHsv, imgHsvCh);
-
-		for (int row = 0; row < imgHsv.rows; row++)
-		{
-			unsigned char *ptr = imgHsvCh[1].ptr<unsigned char>(row);
-	 	
-			for (int col = 0; col < imgHsv.cols; col++) {
-				float tmp = (float)ptr[col] * satFactor;
-				if (tmp > 255.0f) tmp = 255.0f;
-				if (tmp < 0) tmp = 0.0f;
-				ptr[col] = (unsigned char)qRound(tmp);
-			}
-		}
-	
-
-		merge(imgHsvCh, imgHsv);
-		Mat tempImg(blurImg);
-		cvtColor(imgHsv, blurImg, cv::COLOR_HSV2RGB);
-	
-		if(tempImg.type() == CV_8UC4) {	// the retImg is always CV_8UC3, so for pics in CV_8UC4 we need to add one channel
-			std::vector<Mat> inImgCh;
-			split(tempImg, inImgCh);
-			std::vector<Mat> retImgCh;
-			split(blurImg, retImgCh);
-			retImgCh.push_back(inImgCh[3]);
-			merge(retImgCh, blurImg);
-		}
-	}
-	
-	return (DkFakeMiniaturesDialog::mat2QImage(blurImg));
-#else
-	return inImg;
-#endif
+	return DkMiniaturesFilter::apply(inImg, params);
 }
 
-#ifdef WITH_OPENCV
-/**
- * blur filter
- * @param src input Mat
- * @param depthImg distance transform based on a roi
- * @param maxKernel maximum blur kernel size 
- * @return Mat blurres mat
- **/
-Mat DkFakeMiniaturesDialog::blurPanTilt(Mat src, Mat depthImg, int maxKernel) {
-
-	cv::Mat integralImg;
-
-	cv::Mat blurImg(src.size(), src.depth());
-
-	// a template function would have more 'style' here
-	//const double* itgrl64Ptr = 0;
-
-	// images with an area below 4000*4000 can be compuated using 32 bit 
-	cv::integral(src, integralImg, CV_32S);
-	const unsigned int* itgrl32Ptr = integralImg.ptr<unsigned int>();
-
-	for (int rIdx = 0; rIdx < src.rows; rIdx++) {
-
-		unsigned char* blurPtr = blurImg.ptr<unsigned char>(rIdx);	// assuming unsigned char
-		const float* depthPtr = depthImg.ptr<float>(rIdx);
-		const unsigned char* srcPtr = src.ptr<unsigned char>(rIdx);
-
-		for (int cIdx = 0; cIdx < src.cols; cIdx++) {
-
-			// kernel size depends on the distance transform, the user selected
-			//float dpv = depthPtr[cIdx];
-			float ksf = depthPtr[cIdx]*maxKernel*0.5f;
-
-			//if (!ks) {
-			//	blurPtr[cIdx] = srcPtr[cIdx];
-			//	continue;
-			//}
-			
-			int ks = qRound(ksf);
-			if (ksf > 0 && ksf < 2) ks = 2;
-			else if (ks == 0) { // early skip
-				blurPtr[cIdx] = srcPtr[cIdx];
-				continue;
-			}
-
-			// clip all coordinates
-			int left	= qMax(cIdx-ks, 0);
-			int right	= qMin(cIdx+ks+1, src.cols);	// note not cols-1 since integral mImg is src.cols+1
-			int bottom	= qMax(rIdx-ks, 0);				// note top bottom is flipped since -y coords
-			int top		= qMin(rIdx+ks+1, src.rows);
-			int area	= (right-left)*(top-bottom);
-
-			top *= integralImg.cols;
-			bottom *= integralImg.cols;
-
-			float tmp = 0.0f;
-
-			// compute mean kernel
-			if (area && itgrl32Ptr && ks > 1)
-				tmp = (float)(*(itgrl32Ptr + top+right) + *(itgrl32Ptr + bottom+left) - *(itgrl32Ptr + top+left) - *(itgrl32Ptr + bottom+right))/area;
-			else
-				tmp = srcPtr[cIdx];
-
-			if (tmp < 0)
-				tmp = 0.0f;
-			if (tmp > 255)
-				tmp = 255.0f;
-
-			blurPtr[cIdx] = (uchar)qRound(tmp);
-		}
-	}
-
-	return blurImg;
-}
-#endif
-
 /**
  * on button ok pressed event
  **/
@@ -375,9 +306,8 @@ void DkFakeMiniaturesDialog::cancelPressed() {
 void DkFakeMiniaturesDialog::showEvent(QShowEvent *event) {
 
 	isOk = false;	
-	double diag = sqrt(mImg->width()*mImg->width()+mImg->height()*mImg->height());
-	kernelSizeWidget->setToolValue(qMin(qMax(int(diag * 0.02), 5), 140));
-	saturationWidget->setToolValue(2);
+	kernelSizeWidget->setToolValue(DkMiniaturesFilter::defaultKernelSize(mImg->size()));
+	saturationWidget->setToolValue(DkMiniaturesFilter::defaultSaturation());
 
 	QDialog::showEvent(event);
 }
@@ -385,6 +315,7 @@ void DkFakeMiniaturesDialog::showEvent(QShowEvent *event) {
 void DkFakeMiniaturesDialog::setImage(const QImage *img) {
 
 	this->mImg = img;
+	cancelRender();	// invalidate renders of the previous image
 	createImgPreview();
 	drawImgPreview();
 };
@@ -394,6 +325,33 @@ void DkFakeMiniaturesDialog::setImage(const QImage *img) {
  **/
 QImage DkFakeMiniaturesDialog::getImage() {
 
+	mRenderTimer->stop();
+	DkMiniaturesParams params = currentParams();
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+
+	QImage miniature;
+
+	// reuse the speculative render if nothing changed since it was started
+	if (params == mRenderParams) {
+		mRenderWatcher.waitForFinished();
+		miniature = mRenderWatcher.result();
+	}
+	else {
+		cancelRender();	// do not compete with a stale render
+		miniature = DkMiniaturesFilter::apply(*(this->mImg), params);
+	}
+
+	QApplication::restoreOverrideCursor();
+
+	return miniature;
+};
+
+/**
+ * the current filter parameters in full resolution coordinates
+ **/
+DkMiniaturesParams DkFakeMiniaturesDialog::currentParams() const {
+
 	QRect rescaledRect = previewLabel->getROI();
 	rescaledRect.moveTo(rescaledRect.topLeft().x()-previewImgRect.topLeft().x(), rescaledRect.topLeft().y()-previewImgRect.topLeft().y());
 	if(rMin < 1) {
@@ -407,9 +365,57 @@ QImage DkFakeMiniaturesDialog::getImage() {
 	if(rescaledRect.bottomRight().x() > imgRect.bottomRight().x()) rescaledRect.bottomRight().setX(imgRect.bottomRight().x());
 	if(rescaledRect.bottomRight().y() > imgRect.bottomRight().y()) rescaledRect.bottomRight().setY(imgRect.bottomRight().y());
 
-	QImage miniature = applyMiniaturesFilter(*(this->mImg), rescaledRect);
-	return miniature;
-};
+	DkMiniaturesParams params;
+	params.roi = rescaledRect;
+	params.shape = maskShape();
+	params.angle = tilt();
+	params.kernelSize = kernelSizeWidget->getToolValue();
+	params.saturation = saturationWidget->getToolValue();
+
+	return params;
+}
+
+/**
+ * starts rendering the full resolution image in the background.
+ * nothing is done if a render with the current parameters exists already.
+ * A running render with other parameters is canceled, this slot is called again once it finished.
+ **/
+void DkFakeMiniaturesDialog::startRender() {
+
+	if (!mImg || mImg->isNull())
+		return;
+
+	DkMiniaturesParams params = currentParams();
+
+	if (mRenderWatcher.isRunning()) {
+		if (params != mRenderParams)
+			cancelRender();
+		return;
+	}
+
+	if (params == mRenderParams)
+		return;
+
+	mRenderParams = params;
+	mRenderCancel = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+	QImage img = *mImg;	// shallow copy - the dialog might be deleted before the render finishes
+	QSharedPointer<QAtomicInt> cancel = mRenderCancel;
+	mRenderWatcher.setFuture(QtConcurrent::run([img, params, cancel]() {
+		return DkMiniaturesFilter::apply(img, params, cancel.data());
+	}));
+}
+
+/**
+ * stops the speculative render (it returns a null image) and invalidates its parameters
+ **/
+void DkFakeMiniaturesDialog::cancelRender() {
+
+	if (mRenderCancel)
+		mRenderCancel->store(1);
+
+	mRenderParams = DkMiniaturesParams();
+}
 
 /**
  * slot that redraws preview after slider change
@@ -418,8 +424,10 @@ void DkFakeMiniaturesDialog::redrawImgPreview() {
 	
 	QRect rescaledRect = previewLabel->getROI();
 	rescaledRect.moveTo(rescaledRect.topLeft().x()-previewImgRect.topLeft().x(), rescaledRect.topLeft().y()-previewImgRect.topLeft().y());
-	setImagePreview(applyMiniaturesFilter(getScaledImg(), rescaledRect));
+	setImagePreview(renderPreview(rescaledRect));
 	drawImgPreview();
+
+	mRenderTimer->start();
 };
 
 /**************************************************************
@@ -495,7 +503,28 @@ void DkPreviewLabel::paintEvent(QPaintEvent *e) {
 		QPainter painter(this);	
 		painter.setPen(QPen(QBrush(QColor(0,0,0,180)),1,Qt::DashLine));
 		painter.setBrush(QBrush(QColor(255,255,255,120))); 
-		painter.drawRect(selectionRect);
+
+		DkFocusMask::Shape shape = fmDialog->maskShape();
+
+		if (shape == DkFocusMask::mask_rect) {
+			painter.drawRect(selectionRect);
+			return;
+		}
+
+		// draw the tilted shape around the center of the selection
+		QRectF r(selectionRect);
+		double diag = sqrt((double)previewImgRect.width()*previewImgRect.width() + previewImgRect.height()*previewImgRect.height());
+
+		painter.setClipRect(previewImgRect);
+		painter.translate(r.center());
+		painter.rotate(-fmDialog->tilt());	// the tilt is counter clockwise
+
+		if (shape == DkFocusMask::mask_band)
+			painter.drawRect(QRectF(-diag, -r.height()*0.5, 2*diag, r.height()));
+		else if (shape == DkFocusMask::mask_ellipse)
+			painter.drawEllipse(QRectF(-r.width()*0.5, -r.height()*0.5, r.width(), r.height()));
+		else
+			painter.drawLine(QPointF(-diag, 0), QPointF(diag, 0));
 	}
 };
 
@@ -568,7 +597,8 @@ void DkFakeMiniaturesToolWidget::updateSliderVal(int val) {
 void DkFakeMiniaturesToolWidget::setToolValue(int val) {
 
 	if (this->name.compare("DkKernelSize") == 0) { slider->setValue(val);}
-	//else if (this->name.compare("DkSaturation") == 0) { contrast = (int)val; slider->setValue((int)val);}
+	else if (this->name.compare("DkTilt") == 0) { slider->setValue(val);}
+	else if (this->name.compare("DkSaturation") == 0) { slider->setValue(val);}
 };
 
 /**
@@ -578,6 +608,7 @@ int DkFakeMiniaturesToolWidget::getToolValue() {
 
 	if (this->name.compare("DkKernelSize") == 0) return slider->value();
 	else if (this->name.compare("DkSaturation") == 0) return slider->value();
+	else if (this->name.compare("DkTilt") == 0) return slider->value();
 	else return 0;
 };
 
@@ -685,6 +716,59 @@ DkSaturation::DkSaturation(QWidget *parent, DkFakeMiniaturesDialog *parentDialog
 DkSaturation::~DkSaturation() {
 
 
+};
+
+/**************************************************************
+* DkTilt: widget for changing the tilt of the focus mask
+***************************************************************/
+DkTilt::DkTilt(QWidget *parent, DkFakeMiniaturesDialog *parentDialog) 
+	: DkFakeMiniaturesToolWidget(parent, parentDialog){
+
+	name = QString("DkTilt");
+	defaultValue = 0;
+
+	minVal = -90;
+	middleVal = 0;
+	maxVal = 90;
+
+	sliderTitle = new QLabel(tr("Tilt"), this);
+	sliderTitle->move(leftSpacing, topSpacing);
+
+	slider = new QSlider(this);
+	slider->setMinimum(minVal);
+	slider->setMaximum(maxVal);
+	slider->setValue(middleVal);
+	slider->setOrientation(Qt::Horizontal);
+	slider->setGeometry(QRect(leftSpacing, sliderTitle->geometry().bottom() - 5, sliderLength, 20));
+
+	slider->setStyleSheet(
+		QString("QSlider::groove:horizontal {border: 1px solid #999999; height: 4px; margin: 2px 0;")
+		+ QString("background: qlineargradient(x1:0, y1:0, x2:1, y2:0, stop:0 #c8c8c8, stop:1 #c8c8c8);} ")
+		+ QString("QSlider::handle:horizontal {background: qlineargradient(x1:0, y1:0, x2:1, y2:1, stop:0 #d2d2d2, stop:1 #e6e6e6); border: 1px solid #5c5c5c; width: 6px; margin:-4px 0px -6px 0px ;border-radius: 3px;}"));
+
+	sliderSpinBox = new QSpinBox(this);
+	sliderSpinBox->setGeometry(slider->geometry().right() - 45, sliderTitle->geometry().top(), 45, 20);
+	sliderSpinBox->setMinimum(minVal);
+	sliderSpinBox->setMaximum(maxVal);
+	sliderSpinBox->setValue(slider->value());
+
+	connect(slider, SIGNAL(valueChanged(int)), this, SLOT(updateSliderSpinBox(int)));
+	connect(sliderSpinBox, SIGNAL(valueChanged(int)), this, SLOT(updateSliderVal(int)));
+
+	minValLabel = new QLabel(QString::number(minVal), this);
+	minValLabel->move(leftSpacing, slider->geometry().bottom());
+
+	middleValLabel = new QLabel(QString::number(middleVal), this);
+	middleValLabel->move(leftSpacing + sliderLength / 2 - 2, slider->geometry().bottom());
+
+	maxValLabel = new QLabel(QString::number(maxVal), this);
+	maxValLabel->move(slider->geometry().right() - 20, slider->geometry().bottom());
+
+};
+
+DkTilt::~DkTilt() {
+
+
 };
 
 };
@@ -38,27 +38,22 @@
 #include <QDialog>
 #include <QPainter>
 #include <QMouseEvent>
-
- // OpenCV
-#ifdef WITH_OPENCV
-
-#ifdef Q_WS_WIN
-#pragma warning(disable: 4996)
-#endif
-
-#include "opencv2/core/core.hpp"
-#include "opencv2/imgproc/imgproc.hpp"
-
-using namespace cv;
-#endif
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QComboBox>
 
 #pragma warning(pop, 0)	// no warnings from includes - end
 
+#include "DkMiniaturesFilter.h"
+
 namespace nmp {
 
 class DkPreviewLabel;
 class DkKernelSize;
 class DkSaturation;
+class DkTilt;
 
 class DkFakeMiniaturesDialog : public QDialog {
 
@@ -75,6 +70,9 @@ class DkFakeMiniaturesDialog : public QDialog {
 		QImage getImage();
 		QImage applyMiniaturesFilter(QImage inImg, QRect qRoi);
 		QImage getScaledImg() {return scaledImg;};
+		DkFocusMask::Shape maskShape() const;
+		int tilt() const;
+		DkMiniaturesParams currentParams() const;
 		void drawImgPreview();	
 
 	public slots:
@@ -83,6 +81,8 @@ class DkFakeMiniaturesDialog : public QDialog {
 	protected slots:
 		void okPressed();
 		void cancelPressed();
+		void startRender();
+		void maskShapeChanged(int idx);
 
 	protected:
 		bool isOk;
@@ -96,6 +96,14 @@ class DkFakeMiniaturesDialog : public QDialog {
 		float rMin;
 		DkKernelSize *kernelSizeWidget;
 		DkSaturation *saturationWidget;
+		DkTilt *tiltWidget;
+		QComboBox *maskShapeBox;
+
+		// speculative full resolution render
+		QTimer* mRenderTimer;
+		QFutureWatcher<QImage> mRenderWatcher;
+		QSharedPointer<QAtomicInt> mRenderCancel;	// shared with the running render
+		DkMiniaturesParams mRenderParams;
 
 		int previewWidth;
 		int previewHeight;
@@ -106,76 +114,11 @@ class DkFakeMiniaturesDialog : public QDialog {
 		void createLayout();
 		void showEvent(QShowEvent *event);
 		void createImgPreview();		
+		QImage renderPreview(const QRect& roi);
+		void cancelRender();
 
 #ifdef WITH_OPENCV
-		Mat blurPanTilt(Mat src, Mat depthImg, int maxKernel);
-
-	/**
-	 * Converts a QImage to a Mat
-	 * @param mImg formats supported: ARGB32 | RGB32 | RGB888 | Indexed8
-	 * @return cv::Mat the corresponding Mat
-	 **/ 
-	static Mat qImage2Mat(const QImage img) {
-
-		Mat mat2;
-		QImage cImg;	// must be initialized here!	(otherwise the data is lost before clone())
-
-		if (img.format() == QImage::Format_ARGB32 || img.format() == QImage::Format_RGB32 ) {
-			mat2 = Mat(img.height(), img.width(), CV_8UC4, (uchar*)img.bits(), img.bytesPerLine());
-			//qDebug() << "ARGB32 or RGB32";
-		}
-		else if (img.format() == QImage::Format_RGB888) {
-			mat2 = Mat(img.height(), img.width(), CV_8UC3, (uchar*)img.bits(), img.bytesPerLine());
-			//qDebug() << "RGB888";
-		}
-		else if (img.format() == QImage::Format_Indexed8) {
-			mat2 = Mat(img.height(), img.width(), CV_8UC1, (uchar*)img.bits(), img.bytesPerLine());
-			//qDebug() << "indexed...";
-		}
-		else {
-			//qDebug() << "image flag: " << mImg.format();
-			cImg = img.convertToFormat(QImage::Format_ARGB32);
-			mat2 = Mat(cImg.height(), cImg.width(), CV_8UC4, (uchar*)cImg.bits(), cImg.bytesPerLine());
-			//qDebug() << "I need to convert the QImage to ARGB32";
-		}
-
-		mat2 = mat2.clone();	// we need to own the pointer
-
-		return mat2; 
-	}
-
-	/**
-	 * Converts a cv::Mat to a QImage.
-	 * @param mImg supported formats CV8UC1 | CV_8UC3 | CV_8UC4
-	 * @return QImage the corresponding QImage
-	 **/ 
-	static QImage mat2QImage(Mat img) {
-
-		QImage qImg;
-
-		// since Mat header is copied, a new buffer should be allocated (check this!)
-		if (img.depth() == CV_32F)
-			img.convertTo(img, CV_8U, 255);
-
-		if (img.type() == CV_8UC1) {
-			qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_Indexed8);	// opencv uses size_t if for scaling in x64 applications
-			//Mat tmp;
-			//cvtColor(mImg, tmp, CV_GRAY2RGB);	// Qt does not support writing to index8 images
-			//mImg = tmp;
-		}
-		if (img.type() == CV_8UC3) {
-			
-			//cv::cvtColor(mImg, mImg, CV_RGB2BGR);
-			qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_RGB888);
-		}
-		if (img.type() == CV_8UC4) {
-			qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_ARGB32);
-		}
-
-		qImg = qImg.copy();
-
-		return qImg;
-	}
+		DkMiniaturesPreview mPreview;
 #endif
 
 };
@@ -266,4 +209,13 @@ class DkSaturation : public DkFakeMiniaturesToolWidget {
 		~DkSaturation();
 };
 
+class DkTilt : public DkFakeMiniaturesToolWidget {
+
+	Q_OBJECT
+	
+	public:
+		DkTilt(QWidget *parent, DkFakeMiniaturesDialog *parentDialog);
+		~DkTilt();
+};
+
 };
\ No newline at end of file
@@ -27,8 +27,56 @@
 
 #include "DkFakeMiniaturesPlugin.h"
 
+#include "DkSettings.h"
+#include "DkUtils.h"	// for qInfo compatibility
+#include "DkTimer.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QAction>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+#include <QUuid>
+#pragma warning(pop)		// no warnings from includes - end
+
 namespace nmp {
 
+/**
+* Constructor
+**/
+DkFakeMiniaturesPlugin::DkFakeMiniaturesPlugin(QObject* parent) : QObject(parent) {
+
+	// create run IDs
+	QVector<QString> runIds;
+	runIds.resize(id_end);
+
+	for (int idx = 0; idx < id_end; idx++)
+		runIds[idx] = QUuid::createUuid().toString();
+	mRunIDs = runIds.toList();
+
+	// create menu actions
+	QVector<QString> menuNames;
+	menuNames.resize(id_end);
+
+	menuNames[id_fake_miniature] = tr("Fake Miniature...");
+	menuNames[id_apply_preset] = tr("Apply Fake Miniature Preset");
+	mMenuNames = menuNames.toList();
+
+	// create menu status tips
+	QVector<QString> statusTips;
+	statusTips.resize(id_end);
+
+	statusTips[id_fake_miniature] = tr("Select the region in focus and apply a fake miniature (tilt shift) effect.");
+	statusTips[id_apply_preset] = tr("Applies the last accepted fake miniature settings without a dialog (e.g. in batch processing).");
+	mMenuStatusTips = statusTips.toList();
+
+	// save default settings
+	nmc::DefaultSettings settings;
+	loadSettings(settings);
+	saveSettings(settings);
+}
+
 /**
 * Returns descriptive iamge for every ID
 * @param plug-in ID
@@ -38,38 +86,213 @@ QImage DkFakeMiniaturesPlugin::image() const {
    return QImage(":/nomacsPluginFakeMin/img/fakeMinDesc.png");
 };
 
+QString DkFakeMiniaturesPlugin::name() const {
+	return "Fake Miniatures";
+}
+
+QList<QAction*> DkFakeMiniaturesPlugin::createActions(QWidget* parent) {
+
+	if (mActions.empty()) {
+
+		for (int idx = 0; idx < id_end; idx++) {
+			QAction* ca = new QAction(mMenuNames[idx], parent);
+			ca->setObjectName(mMenuNames[idx]);
+			ca->setStatusTip(mMenuStatusTips[idx]);
+			ca->setData(mRunIDs[idx]);	// runID needed for calling function runPlugin()
+			mActions.append(ca);
+		}
+	}
+
+	return mActions;
+}
+
+QList<QAction*> DkFakeMiniaturesPlugin::pluginActions() const {
+	return mActions;
+}
+
 /**
 * Main function: runs plug-in based on its ID
 * @param plug-in ID
 * @param current imgC in the Nomacs viewport
 **/
-QSharedPointer<nmc::DkImageContainer> DkFakeMiniaturesPlugin::runPlugin(const QString &runID, QSharedPointer<nmc::DkImageContainer> imgC) const {
+QSharedPointer<nmc::DkImageContainer> DkFakeMiniaturesPlugin::runPlugin(
+	const QString &runID, 
+	QSharedPointer<nmc::DkImageContainer> imgC, 
+	const nmc::DkSaveInfo&, 
+	QSharedPointer<nmc::DkBatchInfo>&) const {
 
-	qDebug() << "run id" << runID;
-	if (imgC) {
-		QMainWindow* mainWindow = getMainWindow();
-		DkFakeMiniaturesDialog* fakeMiniaturesDialog;
-		if(mainWindow) 
-			fakeMiniaturesDialog = new DkFakeMiniaturesDialog(mainWindow);
-		else 
-			fakeMiniaturesDialog = new DkFakeMiniaturesDialog();
+	if (!mRunIDs.contains(runID) || !imgC)
+		return imgC;
 
-		QImage img = imgC->image();
-		fakeMiniaturesDialog->setImage(&img);
+	if (runID == mRunIDs[id_fake_miniature]) {
 
-		fakeMiniaturesDialog->exec();
+		// batch processing calls us from worker threads - a dialog is not possible there
+		if (QThread::currentThread() != QCoreApplication::instance()->thread()) {
+			qWarning() << "[FakeMiniatures] the dialog cannot be used in batch processing - use" << mMenuNames[id_apply_preset];
+			return imgC;
+		}
 
-		QImage returnImg(imgC->image());
-		if (fakeMiniaturesDialog->wasOkPressed()) 
-			returnImg = fakeMiniaturesDialog->getImage();
+		QImage img = runDialog(imgC->image());
+		if (!img.isNull())
+			imgC->setImage(img, tr("Fake Miniature"));
+	}
+	else if (runID == mRunIDs[id_apply_preset]) {
 
-		fakeMiniaturesDialog->deleteLater();
+		// thread-safe: the filter does not touch any widgets
+		nmc::DkTimer dt;
+		QImage img = imgC->image();
+		img = DkMiniaturesFilter::apply(img, preset().params(img.size()));
+		imgC->setImage(img, tr("Fake Miniature"));
 
-		imgC->setImage(returnImg, tr("Fake Miniature"));
+		qInfo() << "[FakeMiniatures]" << imgC->fileName() << "computed in" << dt;
 	}
 
 	return imgC;
 };
 
-};
+/**
+* Shows the dialog and stores its parameters as preset if it is accepted.
+* @return the filtered image or a null image if the dialog was canceled
+**/
+QImage DkFakeMiniaturesPlugin::runDialog(const QImage& img) const {
+
+	QMainWindow* mainWindow = getMainWindow();
+	DkFakeMiniaturesDialog* fakeMiniaturesDialog;
+	if(mainWindow) 
+		fakeMiniaturesDialog = new DkFakeMiniaturesDialog(mainWindow);
+	else 
+		fakeMiniaturesDialog = new DkFakeMiniaturesDialog();
+
+	fakeMiniaturesDialog->setImage(&img);
 
+	fakeMiniaturesDialog->exec();
+
+	QImage returnImg;
+	if (fakeMiniaturesDialog->wasOkPressed()) {
+		returnImg = fakeMiniaturesDialog->getImage();
+
+		// remember the parameters for the batch action
+		setPreset(DkMiniaturesPreset::fromParams(fakeMiniaturesDialog->currentParams(), img.size()));
+
+		nmc::DefaultSettings settings;
+		saveSettings(settings);
+	}
+
+	fakeMiniaturesDialog->deleteLater();
+
+	return returnImg;
+}
+
+/**
+* Returns a copy of the current preset (thread-safe).
+**/
+DkMiniaturesPreset DkFakeMiniaturesPlugin::preset() const {
+
+	QMutexLocker locker(&mPresetMutex);
+	return mPreset;
+}
+
+/**
+* Replaces the preset that is applied by the batch action (thread-safe).
+**/
+void DkFakeMiniaturesPlugin::setPreset(const DkMiniaturesPreset& preset) const {
+
+	QMutexLocker locker(&mPresetMutex);
+	mPreset = preset;
+}
+
+void DkFakeMiniaturesPlugin::loadSettings(QSettings& settings) {
+
+	DkMiniaturesPreset p = preset();
+
+	settings.beginGroup(name());
+	p.loadSettings(settings);
+	settings.endGroup();
+
+	setPreset(p);
+}
+
+void DkFakeMiniaturesPlugin::saveSettings(QSettings& settings) const {
+
+	settings.beginGroup(name());
+	preset().saveSettings(settings);
+	settings.endGroup();
+}
+
+/**************************************************************
+* DkMiniaturesPreset: size independent filter parameters
+***************************************************************/
+/**
+* Computes the filter parameters for an image of size imgSize.
+**/
+DkMiniaturesParams DkMiniaturesPreset::params(const QSize& imgSize) const {
+
+	DkMiniaturesParams p;
+	p.roi = QRect(
+		qRound(roi.x() * imgSize.width()),
+		qRound(roi.y() * imgSize.height()),
+		qRound(roi.width() * imgSize.width()),
+		qRound(roi.height() * imgSize.height()));
+	p.shape = shape;
+	p.angle = angle;
+	p.saturation = saturation;
+	p.kernelSize = kernelSize;
+	p.engine = engine;
+
+	if (p.kernelSize < 0)
+		p.kernelSize = DkMiniaturesFilter::defaultKernelSize(imgSize);
+
+	return p;
+}
+
+/**
+* Converts the parameters of an image with size imgSize to a preset.
+**/
+DkMiniaturesPreset DkMiniaturesPreset::fromParams(const DkMiniaturesParams& params, const QSize& imgSize) {
+
+	DkMiniaturesPreset p;
+
+	if (!imgSize.isEmpty()) {
+		p.roi = QRectF(
+			(double)params.roi.x() / imgSize.width(),
+			(double)params.roi.y() / imgSize.height(),
+			(double)params.roi.width() / imgSize.width(),
+			(double)params.roi.height() / imgSize.height());
+	}
+
+	p.shape = params.shape;
+	p.angle = params.angle;
+	p.kernelSize = params.kernelSize;
+	p.saturation = params.saturation;
+	p.engine = params.engine;
+
+	return p;
+}
+
+void DkMiniaturesPreset::loadSettings(QSettings& settings) {
+
+	roi = settings.value("FocusRegion", roi).toRectF();
+	angle = settings.value("Tilt", angle).toInt();
+	kernelSize = settings.value("KernelSize", kernelSize).toInt();
+	saturation = settings.value("Saturation", saturation).toInt();
+
+	int sIdx = settings.value("FocusShape", shape).toInt();
+	if (sIdx >= 0 && sIdx < DkFocusMask::mask_end)
+		shape = sIdx;
+
+	int eIdx = settings.value("BlurEngine", engine).toInt();
+	if (eIdx >= 0 && eIdx < DkMiniaturesParams::blur_end)
+		engine = eIdx;
+}
+
+void DkMiniaturesPreset::saveSettings(QSettings& settings) const {
+
+	settings.setValue("FocusRegion", roi);
+	settings.setValue("FocusShape", shape);
+	settings.setValue("Tilt", angle);
+	settings.setValue("KernelSize", kernelSize);
+	settings.setValue("Saturation", saturation);
+	settings.setValue("BlurEngine", engine);
+}
+
+};
@@ -36,21 +36,82 @@
 #include <QStringList>
 #include <QString>
 #include <QMessageBox>
+#include <QRectF>
+#include <QSettings>
+#include <QMutex>
 
 #include "DkPluginInterface.h"
 #include "DkFakeMiniaturesDialog.h"
 
 namespace nmp {
 
-class DkFakeMiniaturesPlugin : public QObject, nmc::DkPluginInterface {
+/**
+ * Fake miniature parameters that do not depend on the image size (the roi is relative).
+ * They are stored when the dialog is accepted and applied to all images by the batch action.
+ **/
+class DkMiniaturesPreset {
+
+public:
+	QRectF roi = QRectF(0.0, 0.7117, 1.0, 0.1941);
+	int shape = DkFocusMask::mask_rect;
+	int angle = 0;
+	int kernelSize = -1;	// -1: 2% of the image diagonal (the dialog's default)
+	int saturation = DkMiniaturesFilter::defaultSaturation();
+	int engine = DkMiniaturesParams::blur_auto;
+
+	DkMiniaturesParams params(const QSize& imgSize) const;
+	static DkMiniaturesPreset fromParams(const DkMiniaturesParams& params, const QSize& imgSize);
+
+	void loadSettings(QSettings& settings);
+	void saveSettings(QSettings& settings) const;
+};
+
+class DkFakeMiniaturesPlugin : public QObject, nmc::DkBatchPluginInterface {
     Q_OBJECT
-    Q_INTERFACES(nmc::DkPluginInterface)
+    Q_INTERFACES(nmc::DkBatchPluginInterface)
 	Q_PLUGIN_METADATA(IID "com.nomacs.ImageLounge.DkFakeMiniaturesPlugin/3.2" FILE "DkFakeMiniaturesPlugin.json")
 
 public:
-    QImage image() const override;
+	DkFakeMiniaturesPlugin(QObject* parent = 0);
 
-	QSharedPointer<nmc::DkImageContainer> runPlugin(const QString &runID = QString(), QSharedPointer<nmc::DkImageContainer> image = QSharedPointer<nmc::DkImageContainer>()) const override;
+    QImage image() const override;
+	QString name() const;
+
+	QList<QAction*> createActions(QWidget* parent) override;
+	QList<QAction*> pluginActions() const override;
+	QSharedPointer<nmc::DkImageContainer> runPlugin(
+		const QString &runID, 
+		QSharedPointer<nmc::DkImageContainer> image, 
+		const nmc::DkSaveInfo& saveInfo,
+		QSharedPointer<nmc::DkBatchInfo>& batchInfo) const override;
+
+	virtual void preLoadPlugin() const {};	// is called before batch processing
+	virtual void postLoadPlugin(const QVector<QSharedPointer<nmc::DkBatchInfo> > &) const {};	// is called after batch processing
+
+	enum {
+		id_fake_miniature,
+		id_apply_preset,
+		// add actions here
+
+		id_end
+	};
+
+	void loadSettings(QSettings& settings) override;
+	void saveSettings(QSettings& settings) const override;
+
+protected:
+	QList<QAction*> mActions;
+	QStringList mRunIDs;
+	QStringList mMenuNames;
+	QStringList mMenuStatusTips;
+
+	// the dialog (const runPlugin) updates the preset while batch workers read it
+	mutable DkMiniaturesPreset mPreset;
+	mutable QMutex mPresetMutex;
+
+	QImage runDialog(const QImage& img) const;
+	DkMiniaturesPreset preset() const;
+	void setPreset(const DkMiniaturesPreset& preset) const;
 };
 
 };
@@ -0,0 +1,187 @@
+/*******************************************************************************************************
+ DkFocusMask.cpp
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkFocusMask.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QCoreApplication>
+#include <QtGlobal>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+ * Creates a focus mask.
+ * @param roi the focus region (image coordinates)
+ * @param shape the mask shape
+ * @param angle the tilt in degree (counter clockwise), it is ignored by mask_rect
+ **/
+DkFocusMask::DkFocusMask(const QRect& roi, Shape shape, double angle) {
+
+	mRoi = roi;
+	mShape = shape;
+	mAngle = angle;
+
+	double rad = qDegreesToRadians(angle);
+	mCos = std::cos(rad);
+	mSin = -std::sin(rad);	// y points down
+
+	// pixel centers
+	mCx = roi.left() + (roi.width() - 1) * 0.5;
+	mCy = roi.top() + (roi.height() - 1) * 0.5;
+	mHalfW = qMax(roi.width() * 0.5, 0.5);
+	mHalfH = qMax(roi.height() * 0.5, 0.5);
+}
+
+/**
+ * Sets the size of the image the mask is applied to.
+ * The depth is normalized such that the farthest pixel is 1.
+ **/
+void DkFocusMask::setImageSize(const QSize& size) {
+
+	mSize = size;
+
+	// all shapes are convex functions - so the maximum is at one of the corners
+	float maxDepth = 0;
+	if (!size.isEmpty()) {
+		int r = size.width() - 1;
+		int b = size.height() - 1;
+		maxDepth = std::max(std::max(rawDepth(0, 0), rawDepth(r, 0)), std::max(rawDepth(0, b), rawDepth(r, b)));
+	}
+
+	mScale = maxDepth > 0 ? 1.0f / maxDepth : 0.0f;
+}
+
+/**
+ * Computes the depth of one image row (setImageSize must be called first).
+ * @param row the row index
+ * @param depth the output with (at least) image width elements in [0 1]
+ **/
+void DkFocusMask::depthRow(int row, float* depth) const {
+
+	const int cols = mSize.width();
+
+	if (mShape == mask_rect) {
+
+		// chessboard distance to the roi (equals cv::distanceTransform with DIST_C)
+		const int l = mRoi.left();
+		const int r = mRoi.right();
+		const float dy = (float)std::max(0, std::max(mRoi.top() - row, row - mRoi.bottom()));
+
+		for (int cIdx = 0; cIdx < cols; cIdx++) {
+			float dx = (float)std::max(0, std::max(l - cIdx, cIdx - r));
+			depth[cIdx] = std::max(dx, dy) * mScale;
+		}
+		return;
+	}
+
+	// coordinates in the rotated frame of the mask - they change linearly along the row
+	double dy = row - mCy;
+	double u = -mCx * mCos + dy * mSin;
+	double v = mCx * mSin + dy * mCos;
+
+	for (int cIdx = 0; cIdx < cols; cIdx++, u += mCos, v -= mSin) {
+
+		float d;
+
+		switch (mShape) {
+		case mask_band:
+			d = (float)std::max(0.0, std::abs(v) - mHalfH);
+			break;
+		case mask_ellipse:
+			d = (float)std::max(0.0, std::sqrt((u*u)/(mHalfW*mHalfW) + (v*v)/(mHalfH*mHalfH)) - 1.0);
+			break;
+		default:	// mask_gradient
+			d = (float)std::abs(v);
+		}
+
+		depth[cIdx] = d * mScale;
+	}
+}
+
+/**
+ * The (not normalized) depth at the pixel x, y.
+ **/
+float DkFocusMask::rawDepth(double x, double y) const {
+
+	if (mShape == mask_rect) {
+		double dx = std::max(0.0, std::max(mRoi.left() - x, x - mRoi.right()));
+		double dy = std::max(0.0, std::max(mRoi.top() - y, y - mRoi.bottom()));
+		return (float)std::max(dx, dy);
+	}
+
+	double u = (x - mCx) * mCos + (y - mCy) * mSin;
+	double v = -(x - mCx) * mSin + (y - mCy) * mCos;
+
+	switch (mShape) {
+	case mask_band:
+		return (float)std::max(0.0, std::abs(v) - mHalfH);
+	case mask_ellipse:
+		return (float)std::max(0.0, std::sqrt((u*u)/(mHalfW*mHalfW) + (v*v)/(mHalfH*mHalfH)) - 1.0);
+	default:	// mask_gradient
+		return (float)std::abs(v);
+	}
+}
+
+QRect DkFocusMask::roi() const {
+	return mRoi;
+}
+
+DkFocusMask::Shape DkFocusMask::shape() const {
+	return mShape;
+}
+
+double DkFocusMask::angle() const {
+	return mAngle;
+}
+
+/**
+ * Returns a user friendly name of the shape.
+ **/
+QString DkFocusMask::shapeName(Shape shape) {
+
+	switch (shape) {
+	case mask_rect:		return QCoreApplication::translate("nmp::DkFocusMask", "Rectangle");
+	case mask_band:		return QCoreApplication::translate("nmp::DkFocusMask", "Tilted Band");
+	case mask_ellipse:	return QCoreApplication::translate("nmp::DkFocusMask", "Ellipse");
+	case mask_gradient:	return QCoreApplication::translate("nmp::DkFocusMask", "Gradient");
+	default:			return QString();
+	}
+}
+
+bool DkFocusMask::operator==(const DkFocusMask& o) const {
+	return mRoi == o.mRoi && mShape == o.mShape && mAngle == o.mAngle && mSize == o.mSize;
+}
+
+bool DkFocusMask::operator!=(const DkFocusMask& o) const {
+	return !(*this == o);
+}
+
+};
@@ -0,0 +1,87 @@
+/*******************************************************************************************************
+ DkFocusMask.h
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QRect>
+#include <QSize>
+#include <QString>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+ * The focus mask defines how much each pixel is blurred.
+ * The depth (0 = sharp, 1 = maximal blur) is evaluated analytically row by row,
+ * so no distance image needs to be computed or stored.
+ * All shapes are derived from the roi:
+ * mask_rect		the roi is sharp, the blur grows with the chessboard distance to it
+ * mask_band		a band with the roi's height through its center, tilted by angle
+ * mask_ellipse		the ellipse inscribed in the roi, rotated by angle
+ * mask_gradient	only the line through the roi's center (tilted by angle) is sharp
+ **/
+class DkFocusMask {
+
+public:
+	enum Shape {
+		mask_rect = 0,
+		mask_band,
+		mask_ellipse,
+		mask_gradient,
+
+		mask_end
+	};
+
+	DkFocusMask(const QRect& roi = QRect(), Shape shape = mask_rect, double angle = 0.0);
+
+	void setImageSize(const QSize& size);
+	void depthRow(int row, float* depth) const;
+
+	QRect roi() const;
+	Shape shape() const;
+	double angle() const;
+	static QString shapeName(Shape shape);
+
+	bool operator==(const DkFocusMask& o) const;
+	bool operator!=(const DkFocusMask& o) const;
+
+protected:
+	QRect mRoi;
+	Shape mShape = mask_rect;
+	double mAngle = 0.0;		// in degree, counter clockwise
+
+	// derived from the parameters
+	QSize mSize;
+	double mCx = 0, mCy = 0;	// roi center
+	double mCos = 1, mSin = 0;	// direction of the band/ellipse axis
+	double mHalfW = 0, mHalfH = 0;
+	float mScale = 0;			// normalizes the depth to [0 1]
+
+	float rawDepth(double x, double y) const;
+};
+
+};
@@ -0,0 +1,337 @@
+/*******************************************************************************************************
+ DkMiniaturesFilter.cpp
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkMiniaturesFilter.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**************************************************************
+* DkMiniaturesFilter: the fake miniature filter
+***************************************************************/
+/**
+ * applies the fake miniature filter - it has no state and can therefore be called from any thread.
+ * @param inImg the input image
+ * @param params the filter parameters (the roi is in inImg coordinates)
+ * @param cancel the filter stops if this flag is set (optional)
+ * @return the filtered image (a null image if it was canceled)
+ **/
+QImage DkMiniaturesFilter::apply(const QImage& inImg, const DkMiniaturesParams& params, const QAtomicInt* cancel) {
+
+#ifdef WITH_OPENCV	
+
+	int kernelSize = params.kernelSize;
+	float satFactor = params.saturation/50.0f + 1; 
+
+	// the filter reads the pixels of inImg directly
+	DkMatView src(inImg);
+
+	// all channels are blurred at once
+	cv::Mat blurImg;
+
+	if (params.blurEngine() == DkMiniaturesParams::blur_stack) {
+		DkBlurStack stack;
+		stack.setCancelFlag(cancel);
+		stack.setImage(src.mat(), kernelSize);
+		blurImg = stack.render(params.mask());
+	}
+	else
+		blurImg = blurPanTilt(src.mat(), params.mask(), kernelSize, cancel);		// 140 is the maximal blurring kernel size
+
+	if (blurImg.empty())
+		return QImage();	// canceled
+
+	blurImg = saturate(blurImg, satFactor);
+	
+	return DkImageBridge::toQImage(blurImg, src.image().format());
+#else
+	return inImg;
+#endif
+}
+
+/**
+ * The default kernel size is 2% of the image diagonal.
+ * @param imgSize the image size
+ * @return the kernel size in [5 140]
+ **/
+int DkMiniaturesFilter::defaultKernelSize(const QSize& imgSize) {
+
+	double diag = std::sqrt((double)imgSize.width()*imgSize.width() + (double)imgSize.height()*imgSize.height());
+	return qMin(qMax(int(diag * 0.02), 5), 140);
+}
+
+/**
+ * The default saturation of the dialog and the batch preset.
+ * @return the saturation in [0 100] (the saturation factor is 1 + saturation/50)
+ **/
+int DkMiniaturesFilter::defaultSaturation() {
+	return 2;
+}
+
+#ifdef WITH_OPENCV
+/**
+ * Boosts the saturation of one row in place of HSV: all channels are moved away from
+ * the brightest channel (V) by the factor k, which keeps the hue and V. k is limited so
+ * that the darkest channel reaches 0 at most (i.e. S is clipped at 255).
+ * The loop is branch free so that the compiler can vectorize it.
+ **/
+template <int cn>
+static void saturateRow(const unsigned char* src, unsigned char* dst, int cols, float satFactor) {
+
+	for (int col = 0; col < cols; col++, src += cn, dst += cn) {
+
+		float c0 = src[0], c1 = src[1], c2 = src[2];
+		float v = std::max(c0, std::max(c1, c2));
+		float vMin = std::min(c0, std::min(c1, c2));
+		float k = std::min(satFactor, v / std::max(v - vMin, 1.0f));
+
+		dst[0] = (unsigned char)(v - (v - c0) * k + 0.5f);
+		dst[1] = (unsigned char)(v - (v - c1) * k + 0.5f);
+		dst[2] = (unsigned char)(v - (v - c2) * k + 0.5f);
+
+		if (cn == 4)
+			dst[3] = src[3];	// alpha is not touched
+	}
+}
+
+/**
+ * Scales the saturation of img (S of HSV) in a single parallel pass.
+ * @param img the blurred image (CV_8UC3 or CV_8UC4 - its alpha channel is kept)
+ * @param satFactor saturation factor, img is returned if it is <= 1
+ * @return the saturated image
+ **/
+cv::Mat DkMiniaturesFilter::saturate(const cv::Mat& img, float satFactor) {
+
+	if (satFactor <= 1 || (img.type() != CV_8UC3 && img.type() != CV_8UC4))
+		return img;
+
+	cv::Mat satImg(img.size(), img.type());
+
+	cv::parallel_for_(cv::Range(0, img.rows), [&](const cv::Range& range) {
+
+		for (int row = range.start; row < range.end; row++) {
+
+			if (img.channels() == 4)
+				saturateRow<4>(img.ptr<unsigned char>(row), satImg.ptr<unsigned char>(row), img.cols, satFactor);
+			else
+				saturateRow<3>(img.ptr<unsigned char>(row), satImg.ptr<unsigned char>(row), img.cols, satFactor);
+		}
+	});
+
+	return satImg;
+}
+
+/**
+ * Computes the integral image of src with 32 bit unsigned accumulators (stored as CV_32SC(cn)).
+ * The sums are computed modulo 2^32, so they wrap around for images larger than ~4000x4000.
+ * The sum of any box with less than 2^24 pixels is below 2^32 and therefore still exact
+ * if it is computed with unsigned arithmetic - this holds for all kernels of the filter.
+ * Contrary to a 64 bit integral the memory is not doubled.
+ * @param src an 8 bit image with any number of channels
+ * @param integralImg the integral image with (rows+1) x (cols+1) pixels
+ **/
+void DkMiniaturesFilter::integral32(const cv::Mat& src, cv::Mat& integralImg) {
+
+	const int cn = src.channels();
+	const int rowElems = src.cols*cn;
+
+	integralImg.create(src.rows+1, src.cols+1, CV_32SC(cn));
+	integralImg.row(0).setTo(0);
+
+	// horizontal prefix sums of every row
+	cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+
+		for (int rIdx = range.start; rIdx < range.end; rIdx++) {
+
+			const unsigned char* srcPtr = src.ptr<unsigned char>(rIdx);
+			unsigned int* iPtr = integralImg.ptr<unsigned int>(rIdx+1);
+
+			for (int c = 0; c < cn; c++)
+				iPtr[c] = 0;
+
+			for (int idx = 0; idx < rowElems; idx++)
+				iPtr[idx+cn] = iPtr[idx] + srcPtr[idx];
+		}
+	});
+
+	// vertical accumulation in column bands
+	const int numElems = (src.cols+1)*cn;
+	const int bandWidth = 256;
+
+	cv::parallel_for_(cv::Range(0, (numElems + bandWidth - 1) / bandWidth), [&](const cv::Range& range) {
+
+		for (int bIdx = range.start; bIdx < range.end; bIdx++) {
+
+			const int start = bIdx*bandWidth;
+			const int end = qMin(start + bandWidth, numElems);
+
+			for (int rIdx = 1; rIdx < integralImg.rows; rIdx++) {
+
+				const unsigned int* prevPtr = integralImg.ptr<unsigned int>(rIdx-1);
+				unsigned int* iPtr = integralImg.ptr<unsigned int>(rIdx);
+
+				for (int idx = start; idx < end; idx++)
+					iPtr[idx] += prevPtr[idx];
+			}
+		}
+	});
+}
+
+/**
+ * blur filter
+ * All channels of the interleaved src are blurred using a single multi-channel
+ * integral image, row bands are processed in parallel.
+ * @param src input cv::Mat (CV_8UC1 - CV_8UC4)
+ * @param mask the focus mask, its depth (0 - 1) scales the kernel of each pixel
+ * @param maxKernel maximum blur kernel size 
+ * @param cancel the blur stops if this flag is set (optional)
+ * @return cv::Mat blurres mat (empty if it was canceled)
+ **/
+cv::Mat DkMiniaturesFilter::blurPanTilt(const cv::Mat& src, const DkFocusMask& mask, int maxKernel, const QAtomicInt* cancel) {
+
+	// 32 bit integrals wrap for large images - box sums are still exact (see integral32)
+	cv::Mat integralImg;
+	integral32(src, integralImg);
+
+	return blurPanTilt(src, integralImg, mask, maxKernel, cancel);
+}
+
+/**
+ * blur filter with a precomputed integral image (see integral32)
+ **/
+cv::Mat DkMiniaturesFilter::blurPanTilt(const cv::Mat& src, const cv::Mat& integralImg, const DkFocusMask& mask, int maxKernel, const QAtomicInt* cancel) {
+
+	cv::Mat blurImg(src.size(), src.type());
+
+	DkFocusMask depthMask(mask);
+	depthMask.setImageSize(QSize(src.cols, src.rows));
+
+	const int cn = src.channels();
+	const size_t iStep = integralImg.step1();	// elements per integral row (cols+1)*cn
+
+	cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+
+		const unsigned int* itgrl32Ptr = integralImg.ptr<unsigned int>();
+		std::vector<float> depth(src.cols);
+
+		for (int rIdx = range.start; rIdx < range.end; rIdx++) {
+
+			if (cancel && cancel->load())
+				return;
+
+			unsigned char* blurPtr = blurImg.ptr<unsigned char>(rIdx);	// assuming unsigned char
+			const float* depthPtr = depth.data();
+			depthMask.depthRow(rIdx, depth.data());
+			const unsigned char* srcPtr = src.ptr<unsigned char>(rIdx);
+
+			for (int cIdx = 0; cIdx < src.cols; cIdx++) {
+
+				// kernel size depends on the focus mask, the user selected
+				float ksf = depthPtr[cIdx]*maxKernel*0.5f;
+
+				int ks = qRound(ksf);
+				if (ksf > 0 && ksf < 2) ks = 2;
+
+				const unsigned char* sPx = srcPtr + cIdx*cn;
+				unsigned char* bPx = blurPtr + cIdx*cn;
+
+				// early skip
+				if (ks <= 1) {
+					for (int c = 0; c < cn; c++)
+						bPx[c] = sPx[c];
+					continue;
+				}
+
+				// clip all coordinates
+				int left	= qMax(cIdx-ks, 0);
+				int right	= qMin(cIdx+ks+1, src.cols);	// note not cols-1 since integral mImg is src.cols+1
+				int bottom	= qMax(rIdx-ks, 0);				// note top bottom is flipped since -y coords
+				int top		= qMin(rIdx+ks+1, src.rows);
+				float invArea = 1.0f/((right-left)*(top-bottom));
+
+				const unsigned int* tr = itgrl32Ptr + top*iStep + right*cn;
+				const unsigned int* tl = itgrl32Ptr + top*iStep + left*cn;
+				const unsigned int* br = itgrl32Ptr + bottom*iStep + right*cn;
+				const unsigned int* bl = itgrl32Ptr + bottom*iStep + left*cn;
+
+				// compute mean kernel - the mean of 8 bit values needs no clipping
+				// the unsigned difference is exact even if the integral wrapped around
+				for (int c = 0; c < cn; c++)
+					bPx[c] = (uchar)qRound((float)(unsigned int)(tr[c] + bl[c] - tl[c] - br[c])*invArea);
+			}
+		}
+	});
+
+	if (cancel && cancel->load())
+		return cv::Mat();
+
+	return blurImg;
+}
+
+/**************************************************************
+* DkMiniaturesPreview: incremental filter for the preview image
+***************************************************************/
+/**
+ * sets a new preview image and computes its integral image
+ **/
+void DkMiniaturesPreview::setImage(const QImage& img) {
+
+	mSrc = DkMatView(img);
+	DkMiniaturesFilter::integral32(mSrc.mat(), mIntegral);
+
+	mBlur.release();
+	mKernelSize = -1;
+}
+
+/**
+ * renders the preview, stages are only recomputed if their input changed:
+ * mask or kernel size -> blur, saturation is always applied (single pass)
+ **/
+QImage DkMiniaturesPreview::render(const DkFocusMask& mask, int kernelSize, int saturation) {
+
+	if (mSrc.mat().empty())
+		return QImage();
+
+	if (mBlur.empty() || mask != mMask || kernelSize != mKernelSize) {
+		mBlur = DkMiniaturesFilter::blurPanTilt(mSrc.mat(), mIntegral, mask, kernelSize);
+		mMask = mask;
+		mKernelSize = kernelSize;
+	}
+
+	float satFactor = saturation/50.0f + 1;
+
+	return DkImageBridge::toQImage(DkMiniaturesFilter::saturate(mBlur, satFactor), mSrc.image().format());
+}
+#endif
+
+};
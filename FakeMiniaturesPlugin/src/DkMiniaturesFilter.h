@@ -0,0 +1,125 @@
+/*******************************************************************************************************
+ DkMiniaturesFilter.h
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QAtomicInt>
+
+#ifdef WITH_OPENCV
+#include "opencv2/core/core.hpp"
+#endif
+#pragma warning(pop)		// no warnings from includes - end
+
+#include "DkFocusMask.h"
+
+#ifdef WITH_OPENCV
+#include "DkImageBridge.h"
+#include "DkBlurStack.h"
+#endif
+
+namespace nmp {
+
+/**
+ * Parameters of the miniature filter in full resolution image coordinates.
+ **/
+class DkMiniaturesParams {
+
+public:
+	enum BlurEngine {
+		blur_auto = 0,		// the stack for large kernels, the integral image otherwise
+		blur_integral,		// exact box per pixel (blurPanTilt)
+		blur_stack,			// interpolated box blur levels (DkBlurStack)
+
+		blur_end
+	};
+
+	QRect roi;
+	int shape = DkFocusMask::mask_rect;
+	int angle = 0;
+	int kernelSize = -1;
+	int saturation = -1;
+	int engine = blur_auto;
+
+	DkFocusMask mask() const { return DkFocusMask(roi, (DkFocusMask::Shape)shape, angle); };
+	BlurEngine blurEngine() const {
+		if (engine == blur_auto)
+			return kernelSize >= 40 ? blur_stack : blur_integral;
+		return (BlurEngine)engine;
+	};
+	bool isValid() const { return kernelSize >= 0; };
+	bool operator==(const DkMiniaturesParams& o) const {
+		return roi == o.roi && shape == o.shape && angle == o.angle && kernelSize == o.kernelSize && saturation == o.saturation && engine == o.engine;
+	};
+	bool operator!=(const DkMiniaturesParams& o) const { return !(*this == o); };
+};
+
+#ifdef WITH_OPENCV
+/**
+ * Preview engine: caches the integral image and the blurred preview image.
+ * Only the stages whose input changed are recomputed, so dragging the saturation
+ * slider does not blur again.
+ **/
+class DkMiniaturesPreview {
+
+public:
+	void setImage(const QImage& img);
+	QImage render(const DkFocusMask& mask, int kernelSize, int saturation);
+
+protected:
+	DkMatView mSrc;
+	cv::Mat mIntegral;
+	cv::Mat mBlur;
+
+	DkFocusMask mMask;
+	int mKernelSize = -1;
+};
+#endif
+
+/**
+ * The fake miniature filter. All parameters are explicit, no function depends
+ * on the dialog, so they can be called from any thread (batch, benchmark).
+ * The stages are public so that they can be cached (see DkMiniaturesPreview) and timed.
+ **/
+class DkMiniaturesFilter {
+
+public:
+	static QImage apply(const QImage& inImg, const DkMiniaturesParams& params, const QAtomicInt* cancel = 0);
+	static int defaultKernelSize(const QSize& imgSize);
+	static int defaultSaturation();
+
+#ifdef WITH_OPENCV
+	static cv::Mat blurPanTilt(const cv::Mat& src, const DkFocusMask& mask, int maxKernel, const QAtomicInt* cancel = 0);
+	static cv::Mat blurPanTilt(const cv::Mat& src, const cv::Mat& integralImg, const DkFocusMask& mask, int maxKernel, const QAtomicInt* cancel = 0);
+	static void integral32(const cv::Mat& src, cv::Mat& integralImg);
+	static cv::Mat saturate(const cv::Mat& img, float satFactor);
+#endif
+};
+
+};
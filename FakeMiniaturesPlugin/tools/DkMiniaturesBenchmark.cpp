@@ -0,0 +1,271 @@
+/*******************************************************************************************************
+ DkMiniaturesBenchmark.cpp
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+// Times the stages of the fake miniature filter for several image sizes and thread counts.
+// usage: miniaturesBenchmark [--image img.jpg] [--sizes 1920x1080,6000x4000] [--threads 1,4] [--json results.json]
+
+#include "DkMiniaturesFilter.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+* Runs func repeat times and returns the median in ms.
+**/
+static double timeMs(const std::function<void()>& func, int repeat) {
+
+	std::vector<double> times;
+
+	for (int idx = 0; idx < repeat; idx++) {
+
+		QElapsedTimer dt;
+		dt.start();
+		func();
+		times.push_back(dt.nsecsElapsed() / 1e6);
+	}
+
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+/**
+* A deterministic test image with gradients and fine texture (so that the blur has something to do).
+**/
+static QImage syntheticImage(const QSize& size) {
+
+	QImage img(size, QImage::Format_ARGB32);
+
+	for (int rIdx = 0; rIdx < img.height(); rIdx++) {
+
+		QRgb* ptr = (QRgb*)img.scanLine(rIdx);
+
+		for (int cIdx = 0; cIdx < img.width(); cIdx++) {
+
+			unsigned int h = (unsigned int)(cIdx * 73856093u) ^ (unsigned int)(rIdx * 19349663u);
+			int noise = (int)((h * 2654435761u) >> 27);	// 0 - 31
+			ptr[cIdx] = qRgb(
+				(cIdx * 255 / qMax(img.width(), 1) + noise) & 0xff,
+				(rIdx * 255 / qMax(img.height(), 1) + noise) & 0xff,
+				((cIdx + rIdx) & 0xff) ^ noise);
+		}
+	}
+
+	return img;
+}
+
+static bool parseSize(const QString& str, QSize& size) {
+
+	QStringList wh = str.split('x');
+
+	if (wh.size() != 2)
+		return false;
+
+	size = QSize(wh[0].toInt(), wh[1].toInt());
+	return !size.isEmpty();
+}
+
+/**
+* Times all stages on img with the number of threads that is currently set.
+**/
+static QJsonObject benchmark(const QImage& img, const DkMiniaturesParams& params, int repeat) {
+
+	QJsonObject stages;
+	DkMatView src(img);
+	DkFocusMask mask = params.mask();
+	float satFactor = params.saturation / 50.0f + 1;
+
+	// the depth of each pixel (formerly the distance transform)
+	stages["depth"] = timeMs([&]() {
+
+		DkFocusMask m(mask);
+		m.setImageSize(img.size());
+		cv::Mat depth(img.height(), img.width(), CV_32FC1);
+
+		cv::parallel_for_(cv::Range(0, depth.rows), [&](const cv::Range& range) {
+			for (int rIdx = range.start; rIdx < range.end; rIdx++)
+				m.depthRow(rIdx, depth.ptr<float>(rIdx));
+		});
+	}, repeat);
+
+	cv::Mat integralImg;
+	stages["integral"] = timeMs([&]() { DkMiniaturesFilter::integral32(src.mat(), integralImg); }, repeat);
+
+	cv::Mat blurImg;
+	stages["blur"] = timeMs([&]() { blurImg = DkMiniaturesFilter::blurPanTilt(src.mat(), integralImg, mask, params.kernelSize); }, repeat);
+
+	DkBlurStack stack;
+	stages["stackBuild"] = timeMs([&]() { stack.setImage(src.mat(), params.kernelSize); }, repeat);
+	stages["stackRender"] = timeMs([&]() { stack.render(mask); }, repeat);
+
+	stages["saturation"] = timeMs([&]() { DkMiniaturesFilter::saturate(blurImg, satFactor); }, repeat);
+
+	// end to end (including the QImage conversions)
+	DkMiniaturesParams p = params;
+	p.engine = DkMiniaturesParams::blur_integral;
+	stages["totalIntegral"] = timeMs([&]() { DkMiniaturesFilter::apply(img, p); }, repeat);
+
+	p.engine = DkMiniaturesParams::blur_stack;
+	stages["totalStack"] = timeMs([&]() { DkMiniaturesFilter::apply(img, p); }, repeat);
+
+	return stages;
+}
+
+};
+
+int main(int argc, char** argv) {
+
+	using namespace nmp;
+
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("miniaturesBenchmark");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Times the stages of the fake miniature filter (in ms, median of all repeats).");
+	parser.addHelpOption();
+
+	QCommandLineOption imageOpt("image", "Input image, it is resized to all sizes (default: synthetic image).", "file");
+	QCommandLineOption sizesOpt("sizes", "Comma separated image sizes (default: 1920x1080,4000x3000,6000x4000).", "list", "1920x1080,4000x3000,6000x4000");
+	QCommandLineOption threadsOpt("threads", "Comma separated thread counts (default: 1 and the ideal thread count).", "list");
+	QCommandLineOption kernelOpt("kernel", "Kernel size (default: 2% of the image diagonal).", "size");
+	QCommandLineOption saturationOpt("saturation", QString("Saturation (default: %1, as the dialog).").arg(DkMiniaturesFilter::defaultSaturation()), "value", QString::number(DkMiniaturesFilter::defaultSaturation()));
+	QCommandLineOption shapeOpt("shape", "Focus mask: rect, band, ellipse or gradient (default: rect).", "name", "rect");
+	QCommandLineOption angleOpt("angle", "Tilt of the focus mask in degree (default: 0).", "value", "0");
+	QCommandLineOption repeatOpt("repeat", "Number of runs per stage (default: 5).", "N", "5");
+	QCommandLineOption jsonOpt("json", "Writes the results to <file> (default: stdout).", "file");
+	parser.addOptions({ imageOpt, sizesOpt, threadsOpt, kernelOpt, saturationOpt, shapeOpt, angleOpt, repeatOpt, jsonOpt });
+	parser.process(app);
+
+	QImage inImg;
+	if (parser.isSet(imageOpt)) {
+
+		inImg = QImage(parser.value(imageOpt));
+
+		if (inImg.isNull()) {
+			qCritical() << "could not load" << parser.value(imageOpt);
+			return 1;
+		}
+	}
+
+	QVector<QSize> sizes;
+	for (const QString& str : parser.value(sizesOpt).split(',')) {
+
+		QSize s;
+		if (!parseSize(str, s)) {
+			qCritical() << "illegal size:" << str;
+			return 1;
+		}
+		sizes << s;
+	}
+
+	QVector<int> threads;
+	if (parser.isSet(threadsOpt)) {
+		for (const QString& str : parser.value(threadsOpt).split(','))
+			threads << qMax(str.toInt(), 1);
+	}
+	else {
+		threads << 1;
+		if (QThread::idealThreadCount() > 1)
+			threads << QThread::idealThreadCount();
+	}
+
+	QStringList shapes = QStringList() << "rect" << "band" << "ellipse" << "gradient";
+	int shape = shapes.indexOf(parser.value(shapeOpt));
+	if (shape == -1) {
+		qCritical() << "unknown shape:" << parser.value(shapeOpt);
+		return 1;
+	}
+
+	int repeat = qMax(parser.value(repeatOpt).toInt(), 1);
+
+	QJsonArray runs;
+
+	for (const QSize& s : sizes) {
+
+		QImage img = inImg.isNull() ? syntheticImage(s) : inImg.scaled(s, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).convertToFormat(QImage::Format_ARGB32);
+
+		// same default region as the dialog
+		DkMiniaturesParams params;
+		params.roi = QRect(0, qRound(s.height()*0.7117), s.width(), qRound(s.height()*0.1941));
+		params.shape = shape;
+		params.angle = parser.value(angleOpt).toInt();
+		params.saturation = parser.value(saturationOpt).toInt();
+		params.kernelSize = parser.isSet(kernelOpt) ? parser.value(kernelOpt).toInt() : DkMiniaturesFilter::defaultKernelSize(s);
+
+		for (int t : threads) {
+
+			cv::setNumThreads(t);
+			qInfo() << "benchmarking" << s << "with" << t << "threads";
+
+			QJsonObject run;
+			run["width"] = s.width();
+			run["height"] = s.height();
+			run["threads"] = t;
+			run["kernelSize"] = params.kernelSize;
+			run["stages"] = benchmark(img, params, repeat);
+			runs.append(run);
+		}
+	}
+
+	QJsonObject results;
+	results["shape"] = parser.value(shapeOpt);
+	results["saturation"] = parser.value(saturationOpt).toInt();
+	results["repeat"] = repeat;
+	results["unit"] = "ms";
+	results["runs"] = runs;
+
+	QByteArray json = QJsonDocument(results).toJson();
+
+	if (parser.isSet(jsonOpt)) {
+
+		QFile file(parser.value(jsonOpt));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+			qCritical() << "could not write" << file.fileName();
+			return 1;
+		}
+		file.write(json);
+	}
+	else
+		QTextStream(stdout) << json;
+
+	return 0;
+}
@@ -0,0 +1,269 @@
+/*******************************************************************************************************
+ DkPageCache.cpp
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2015 Markus Diem <markus@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkPageCache.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+* Creates a cache in dirPath - the directory is created when the first entry is saved.
+* @param dirPath the cache directory, the application's cache location is used if it is empty
+**/
+DkPageCache::DkPageCache(const QString& dirPath) {
+
+	mDirPath = dirPath;
+
+	if (mDirPath.isEmpty())
+		mDirPath = QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("page-extraction");
+}
+
+QString DkPageCache::dirPath() const {
+	return mDirPath;
+}
+
+/**
+* Hashes the content of a file - this is much cheaper than hashing the decoded pixels.
+* @return an empty array if the file cannot be read
+**/
+QByteArray DkPageCache::fileHash(const QString& filePath) {
+
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly))
+		return QByteArray();
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	if (!hash.addData(&file))
+		return QByteArray();
+
+	return hash.result();
+}
+
+/**
+* Hashes the pixels of img (used if the image was edited before the segmentation).
+**/
+QByteArray DkPageCache::imageHash(const QImage& img) {
+
+	if (img.isNull())
+		return QByteArray();
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+
+	int header[3] = { img.width(), img.height(), img.format() };
+	hash.addData(reinterpret_cast<const char*>(header), sizeof(header));
+
+	// padding bytes are undefined
+	int lineBytes = (img.width() * img.depth() + 7) / 8;
+	for (int rIdx = 0; rIdx < img.height(); rIdx++)
+		hash.addData(reinterpret_cast<const char*>(img.constScanLine(rIdx)), lineBytes);
+
+	return hash.result();
+}
+
+/**
+* Returns the cache key of an image content hash and the parameters it was segmented with.
+**/
+QString DkPageCache::key(const QByteArray& contentHash, const QByteArray& params) const {
+
+	if (contentHash.isEmpty())
+		return QString();
+
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(contentHash);
+	hash.addData(params);
+	hash.addData(QByteArray::number(version));
+
+	return QString::fromLatin1(hash.result().toHex());
+}
+
+QString DkPageCache::filePath(const QString& key) const {
+	return QDir(mDirPath).filePath(key + ".json");
+}
+
+/**
+* Marks a cache entry as recently used (prune() removes the least recently used entries first).
+* @param filePath the entry
+* @param data the entry's content, it is rewritten if the file time cannot be set (Qt < 5.10)
+**/
+static void touch(const QString& filePath, const QByteArray& data) {
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+	Q_UNUSED(data);
+	QFile file(filePath);
+
+	if (file.open(QIODevice::ReadWrite))
+		file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+#else
+	QSaveFile file(filePath);
+
+	if (file.open(QIODevice::WriteOnly)) {
+		file.write(data);
+		file.commit();
+	}
+#endif
+}
+
+/**
+* Loads the cached rectangles of key.
+* @return false if nothing is cached for key (an empty result is a valid cache entry)
+**/
+bool DkPageCache::load(const QString& key, std::vector<DkPolyRect>& rects) const {
+
+	if (key.isEmpty())
+		return false;
+
+	QFile file(filePath(key));
+
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QByteArray data = file.readAll();
+	file.close();
+
+	QJsonDocument doc = QJsonDocument::fromJson(data);
+
+	if (!doc.isObject() || doc.object().value("version").toInt() != version) {
+		qDebug() << "[DkPageCache] ignoring invalid cache entry" << file.fileName();
+		return false;
+	}
+
+	rects.clear();
+
+	for (const QJsonValue& r : doc.object().value("rects").toArray()) {
+
+		QJsonArray coords = r.toArray();
+		std::vector<nmc::DkVector> pts;
+
+		for (int idx = 0; idx + 1 < coords.size(); idx += 2)
+			pts.push_back(nmc::DkVector((float)coords[idx].toDouble(), (float)coords[idx+1].toDouble()));
+
+		rects.push_back(DkPolyRect(pts));
+	}
+
+	touch(file.fileName(), data);
+
+	return true;
+}
+
+/**
+* Stores rects for key.
+**/
+bool DkPageCache::save(const QString& key, const std::vector<DkPolyRect>& rects) const {
+
+	if (key.isEmpty())
+		return false;
+
+	QJsonArray rectsJson;
+
+	for (const DkPolyRect& r : rects) {
+
+		QJsonArray coords;
+		for (const nmc::DkVector& v : r.getCorners())
+			coords << (double)v.x << (double)v.y;
+
+		rectsJson.append(coords);
+	}
+
+	QJsonObject o;
+	o["version"] = version;
+	o["rects"] = rectsJson;
+
+	if (!QDir().mkpath(mDirPath)) {
+		qWarning() << "[DkPageCache] could not create" << mDirPath;
+		return false;
+	}
+
+	// QSaveFile replaces the entry atomically - concurrent writers of the same key are harmless
+	QSaveFile file(filePath(key));
+
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "[DkPageCache] could not write" << file.fileName();
+		return false;
+	}
+
+	file.write(QJsonDocument(o).toJson(QJsonDocument::Compact));
+
+	return file.commit();
+}
+
+/**
+* Sets the limits that are enforced by prune().
+* @param maxBytes the maximal size of all entries (<= 0 for no limit)
+* @param maxAgeDays entries older than maxAgeDays are removed (<= 0 for no limit)
+**/
+void DkPageCache::setLimits(qint64 maxBytes, int maxAgeDays) {
+	mMaxBytes = maxBytes;
+	mMaxAgeDays = maxAgeDays;
+}
+
+/**
+* Removes entries that were not used within the age limit and then the
+* least recently used entries until the cache is smaller than the size limit.
+* Entries are sorted by their modification time, which load() updates.
+**/
+void DkPageCache::prune() const {
+
+	QDir dir(mDirPath);
+
+	if (!dir.exists())
+		return;
+
+	// least recently used entries last
+	QFileInfoList entries = dir.entryInfoList(QStringList() << "*.json", QDir::Files, QDir::Time);
+	QDateTime minDate = QDateTime::currentDateTime().addDays(-mMaxAgeDays);
+
+	qint64 bytes = 0;
+	int numRemoved = 0;
+
+	for (const QFileInfo& fi : entries) {
+
+		bytes += fi.size();
+
+		if ((mMaxAgeDays > 0 && fi.lastModified() < minDate) ||
+			(mMaxBytes > 0 && bytes > mMaxBytes)) {
+
+			if (QFile::remove(fi.absoluteFilePath()))
+				numRemoved++;
+		}
+	}
+
+	if (numRemoved > 0)
+		qDebug() << "[DkPageCache]" << numRemoved << "entries removed from" << mDirPath;
+}
+
+};
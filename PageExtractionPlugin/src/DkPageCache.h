@@ -0,0 +1,73 @@
+/*******************************************************************************************************
+ DkPageCache.h
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2015 Markus Diem <markus@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include "DkPageSegmentationUtils.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QByteArray>
+#include <QImage>
+#include <QtGlobal>
+#include <QString>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+* Persistent cache of page segmentation results.
+* Every result is stored in a small json file whose name is the hash of the image content
+* and the segmentation parameters, so re-running a batch with different output options
+* skips the segmentation. Files are written atomically, hence the cache can be used from
+* several batch threads at once.
+* The directory is created with the first entry. prune() keeps the cache below
+* a size and age limit by removing the least recently used entries.
+**/
+class DkPageCache {
+
+public:
+	DkPageCache(const QString& dirPath = QString());
+
+	static QByteArray fileHash(const QString& filePath);
+	static QByteArray imageHash(const QImage& img);
+
+	QString key(const QByteArray& contentHash, const QByteArray& params) const;
+	bool load(const QString& key, std::vector<DkPolyRect>& rects) const;
+	bool save(const QString& key, const std::vector<DkPolyRect>& rects) const;
+
+	void setLimits(qint64 maxBytes, int maxAgeDays);
+	void prune() const;
+
+	QString dirPath() const;
+
+protected:
+	QString mDirPath;
+	qint64 mMaxBytes = 64 * 1024 * 1024;
+	int mMaxAgeDays = 30;
+
+	static const int version = 1;	// increase if the segmentation results change
+	QString filePath(const QString& key) const;
+};
+
+};
@@ -0,0 +1,104 @@
+/*******************************************************************************************************
+ DkPageEvaluation.cpp
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2015 Markus Diem
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkPageEvaluation.h"
+#include "DkPageSegmentationUtils.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QXmlStreamReader>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+* Loads the ground truth polygon of imgPath.
+* @return an empty polygon if no GT exists
+**/
+QPolygonF DkPageEvaluation::readGT(const QString& imgPath) {
+
+	QFileInfo imgInfo(imgPath);
+
+	QFileInfo xmlFileI(imgInfo.absolutePath(), imgInfo.baseName() + ".xml");
+
+	if (!xmlFileI.exists()) {
+		qWarning() << "no xml file found: " << xmlFileI.absoluteFilePath();
+		return QPolygonF();
+	}
+	QFile xmlFile(xmlFileI.absoluteFilePath());
+	if (!xmlFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+		qWarning() << "could not load" << xmlFileI.absoluteFilePath();
+		return QPolygonF();
+	}
+
+	QXmlStreamReader xmlReader(&xmlFile);
+	QPolygonF rect;
+
+	while (!xmlReader.atEnd() && !xmlReader.hasError()) {
+
+		QString tag = xmlReader.qualifiedName().toString();
+
+		if (xmlReader.tokenType() == QXmlStreamReader::StartElement && tag == "dmrz") {
+			
+			for (int idx = 0; idx < 4; idx++) {
+
+				QPoint p;
+				p.setX(xmlReader.attributes().value("x" + QString::number(idx)).toInt());
+				p.setY(xmlReader.attributes().value("y" + QString::number(idx)).toInt());
+				rect << p;
+			}
+		}
+		xmlReader.readNext();
+	}
+
+	return rect;
+}
+
+/**
+* Computes the Jaccard index (intersection over union) of two polygons analytically.
+* @return 0 if any of the polygons is empty
+**/
+double DkPageEvaluation::jaccardIndex(const QPolygonF& gt, const QPolygonF& computed) {
+
+	if (gt.size() < 3 || computed.size() < 3)
+		return 0.0;
+
+	std::vector<nmc::DkVector> gtPts, cPts;
+	for (const QPointF& p : gt)
+		gtPts.push_back(nmc::DkVector(p));
+	for (const QPointF& p : computed)
+		cPts.push_back(nmc::DkVector(p));
+
+	DkPolyRect gtRect(gtPts);
+	DkPolyRect cRect(cPts);
+
+	double andVal = gtRect.intersectArea(cRect);
+	double orVal = gtRect.getArea() + cRect.getArea() - andVal;
+
+	return orVal > 0 ? andVal/orVal : 0.0;
+}
+
+};
@@ -0,0 +1,45 @@
+/*******************************************************************************************************
+ DkPageEvaluation.h
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2015 Markus Diem <markus@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QPolygonF>
+#include <QString>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+* Ground truth helpers for evaluating the page segmentation.
+* The GT of an image img.jpg is stored in img.xml (dmrz element with x0,y0 ... x3,y3 attributes).
+**/
+class DkPageEvaluation {
+
+public:
+	static QPolygonF readGT(const QString& imgPath);
+	static double jaccardIndex(const QPolygonF& gt, const QPolygonF& computed);
+};
+
+};
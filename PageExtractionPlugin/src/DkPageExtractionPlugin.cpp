@@ -24,6 +24,8 @@
 
 #include "DkPageExtractionPlugin.h"
 #include "DkPageSegmentation.h"
+#include "DkPageEvaluation.h"
+#include "DkImageBridge.h"
 
 #include "DkImageStorage.h"
 #include "DkMetaData.h"
@@ -39,8 +41,10 @@
 #include <QDateTime>
 #include <QDir>
 #include <QSettings>
-
-#include <QXmlStreamReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtConcurrentMap>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmp {
@@ -65,6 +69,8 @@ DkPageExtractionPlugin::DkPageExtractionPlugin(QObject* parent) : QObject(parent
 	menuNames[id_crop_to_page] = tr("Crop to Page");
 	menuNames[id_crop_to_metadata] = tr("Crop to Metadata");
 	menuNames[id_draw_to_page] = tr("Draw to Page");
+	menuNames[id_rectify_page] = tr("Rectify Page");
+	menuNames[id_split_pages] = tr("Split Pages");
 	//menuNames[id_eval_page] = tr("Evaluate Page");
 	mMenuNames = menuNames.toList();
 
@@ -75,6 +81,8 @@ DkPageExtractionPlugin::DkPageExtractionPlugin(QObject* parent) : QObject(parent
 	statusTips[id_crop_to_page] = tr("Finds a page in a document image and then crops the image to that page.");
 	statusTips[id_crop_to_metadata] = tr("Finds a page in a document image and then saves the coordinates to the XMP metadata.");
 	statusTips[id_draw_to_page] = tr("Finds a page in a document image and then draws the found document boundaries.");
+	statusTips[id_rectify_page] = tr("Finds a page in a document image and then removes its perspective distortion.");
+	statusTips[id_split_pages] = tr("Finds all pages in a document image (e.g. a book spread) and saves each page as a separate image.");
 	//statusTips[id_eval_page] = tr("Loads GT and computes the Jaccard index.");
 	mMenuStatusTips = statusTips.toList();
 
@@ -137,16 +145,14 @@ QSharedPointer<nmc::DkImageContainer> DkPageExtractionPlugin::runPlugin(
 	if (!mRunIDs.contains(runID) || !imgC)
 		return imgC;
 		
-	cv::Mat img = nmc::DkImage::qImage2Mat(imgC->image());
-	bool alternativeMethod = mMethod == m_bhaskar;
+	// the segmentation reads the pixels of imgC directly (the view must outlive segM)
+	DkMatView img(imgC->image());
 	
-	DkPageSegmentation segM(img, alternativeMethod);
+	DkPageSegmentation segM(mSegmentation);	// copy the parameters
+	segM.setImage(img.mat());
+	segM.setAlternativeMethod(mMethod == m_bhaskar);
 
-	// run the page segmentation
-	nmc::DkTimer dt;
-	segM.compute();
-	segM.filterDuplicates();
-	qDebug() << "page segmentation takes" << dt;
+	segment(segM, imgC);
 
 	// crop image
 	if(runID == mRunIDs[id_crop_to_page]) {
@@ -171,11 +177,19 @@ QSharedPointer<nmc::DkImageContainer> DkPageExtractionPlugin::runPlugin(
 		segM.draw(dImg);
 		imgC->setImage(dImg, tr("Page Annotated"));
 	}
+	// warp the page to a rectangle
+	else if(runID == mRunIDs[id_rectify_page]) {
+		imgC->setImage(segM.getRectified(imgC->image()), tr("Page Rectified"));
+	}
+	// save all pages - the first page is returned
+	else if(runID == mRunIDs[id_split_pages]) {
+		imgC->setImage(splitPages(imgC->image(), segM, saveInfo), tr("Pages Split"));
+	}
 	//else if (runID == mRunIDs[id_eval_page]) {
 
 	//	QImage dImg = imgC->image();
 
-	//	QPolygonF gt = readGT(imgC->filePath());
+	//	QPolygonF gt = DkPageEvaluation::readGT(imgC->filePath());
 	//	
 	//	QPen mPen(QColor(100, 200, 50));
 	//	mPen.setWidth(10);
@@ -187,7 +201,7 @@ QSharedPointer<nmc::DkImageContainer> DkPageExtractionPlugin::runPlugin(
 	//	segM.draw(dImg);
 	//	imgC->setImage(dImg, tr("Result vs GT"));
 
-	//	double ji = jaccardIndex(imgC->image().size(), gt, segM.getMaxRect().toPolygon());
+	//	double ji = DkPageEvaluation::jaccardIndex(gt, segM.getMaxRect().toPolygon());
 
 	//	QString data = imgC->fileName() + ", " + QString::number(ji) + "\n";
 	//	qDebug() << data;
@@ -204,84 +218,166 @@ QSharedPointer<nmc::DkImageContainer> DkPageExtractionPlugin::runPlugin(
 	return imgC;
 }
 
-void DkPageExtractionPlugin::loadSettings(QSettings & settings) {
+/**
+* Runs the page segmentation on imgC or loads its result from the cache.
+* Unedited images are identified by their file content, edited ones by their pixels.
+**/
+void DkPageExtractionPlugin::segment(DkPageSegmentation& segM, QSharedPointer<nmc::DkImageContainer> imgC) const {
 
-	settings.beginGroup(name());
-	int mIdx = settings.value("Method", mMethod).toInt();
-	if (mIdx >= 0 && mIdx < m_end)
-		mMethod = (MethodIndex)mIdx;
-	settings.endGroup();
-}
+	nmc::DkTimer dt;
+	QString cacheKey;
 
-void DkPageExtractionPlugin::saveSettings(QSettings & settings) const {
+	if (mUseCache) {
 
-	settings.beginGroup(name());
-	settings.setValue("Method", mMethod);
-	settings.endGroup();
+		QByteArray contentHash;
+		if (!imgC->isEdited())
+			contentHash = DkPageCache::fileHash(imgC->filePath());
+		if (contentHash.isEmpty())
+			contentHash = DkPageCache::imageHash(imgC->image());
+
+		cacheKey = mCache.key(contentHash, segM.parameterKey());
+
+		std::vector<DkPolyRect> rects;
+		if (mCache.load(cacheKey, rects)) {
+			segM.setRects(rects);
+			qInfo() << "[PageExtraction]" << imgC->fileName() << "loaded from cache in" << dt;
+			return;
+		}
+	}
+
+	// run the page segmentation
+	segM.compute();
+	segM.filterDuplicates();
+	qInfo() << "[PageExtraction]" << imgC->fileName() << "segmented in" << dt << "preset:" << presetName();
+
+	if (mUseCache)
+		mCache.save(cacheKey, segM.getRects());
 }
 
-QPolygonF DkPageExtractionPlugin::readGT(const QString& imgPath) const {
+/**
+* Crops all pages found by segM and saves them concurrently next to the batch output (name-p2.jpg, name-p3.jpg, ...).
+* The page coordinates are written to a sidecar file (name.pages.json).
+* @return the first page which is saved by the batch process itself
+**/
+QImage DkPageExtractionPlugin::splitPages(const QImage& img, const DkPageSegmentation& segM, const nmc::DkSaveInfo& saveInfo) const {
 
-	QFileInfo imgInfo(imgPath);
+	std::vector<DkPolyRect> pages = segM.getPages();
 
-	QFileInfo xmlFileI(imgInfo.absolutePath(), imgInfo.baseName() + ".xml");
+	if (pages.empty())
+		return img;
 
-	if (!xmlFileI.exists()) {
-		qWarning() << "no xml file found: " << xmlFileI.absoluteFilePath();
-		return QPolygonF();
-	}
-	QFile xmlFile(xmlFileI.absoluteFilePath());
-	if (!xmlFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-		qWarning() << "could not load" << xmlFileI.absoluteFilePath();
-		return QPolygonF();
-	}
+	QFileInfo outInfo(saveInfo.outputFilePath());
+	QVector<QString> filePaths(pages.size());
+	filePaths[0] = outInfo.absoluteFilePath();
 
-	QXmlStreamReader xmlReader(&xmlFile);
-	QPolygonF rect;
+	for (int idx = 1; idx < (int)pages.size(); idx++)
+		filePaths[idx] = QFileInfo(outInfo.absolutePath(), outInfo.completeBaseName() + "-p" + QString::number(idx + 1) + "." + outInfo.suffix()).absoluteFilePath();
 
-	while (!xmlReader.atEnd() && !xmlReader.hasError()) {
+	QVector<QImage> pageImgs(pages.size());
+	QVector<int> indexes;
+	for (int idx = 0; idx < (int)pages.size(); idx++)
+		indexes << idx;
 
-		QString tag = xmlReader.qualifiedName().toString();
+	// the batch process saves the first page, we crop & save all others in parallel
+	bool saveAll = !saveInfo.outputFilePath().isEmpty();
+	QtConcurrent::blockingMap(indexes, [&](int idx) {
 
-		if (xmlReader.tokenType() == QXmlStreamReader::StartElement && tag == "dmrz") {
-			
-			for (int idx = 0; idx < 4; idx++) {
+		pageImgs[idx] = segM.getCropped(img, pages[idx]);
 
-				QPoint p;
-				p.setX(xmlReader.attributes().value("x" + QString::number(idx)).toInt());
-				p.setY(xmlReader.attributes().value("y" + QString::number(idx)).toInt());
-				rect << p;
-			}
-		}
-		xmlReader.readNext();
+		if (idx > 0 && saveAll && !pageImgs[idx].save(filePaths[idx], 0, saveInfo.compression()))
+			qWarning() << "could not save" << filePaths[idx];
+	});
+
+	if (!saveAll) {
+		qWarning() << "[DkPageExtractionPlugin] no output path - only the first of" << pages.size() << "pages is kept";
+		return pageImgs[0];
 	}
 
-	return rect;
-}
+	// sidecar with the page coordinates in the input image
+	QJsonArray pagesJson;
+	for (int idx = 0; idx < (int)pages.size(); idx++) {
 
-double DkPageExtractionPlugin::jaccardIndex(const QSize & imgSize, const QPolygonF & gt, const QPolygonF & computed) const {
-	
-	cv::Mat gtImg = nmc::DkImage::qImage2Mat(drawPoly(imgSize, gt));
-	cv::Mat evImg = nmc::DkImage::qImage2Mat(drawPoly(imgSize, computed));
+		QJsonArray poly;
+		for (const nmc::DkVector& v : pages[idx].getCorners())
+			poly.append(QJsonArray{ v.x, v.y });
+
+		QJsonObject pj;
+		pj["file"] = QFileInfo(filePaths[idx]).fileName();
+		pj["polygon"] = poly;
+		pagesJson.append(pj);
+	}
+
+	QJsonObject sidecar;
+	sidecar["source"] = saveInfo.inputFilePath();
+	sidecar["width"] = img.width();
+	sidecar["height"] = img.height();
+	sidecar["pages"] = pagesJson;
 
-	double andVal = (double)cv::sum(gtImg & evImg)[0];
-	double orVal = (double)cv::sum(gtImg | evImg)[0];
+	QFile file(QFileInfo(outInfo.absolutePath(), outInfo.completeBaseName() + ".pages.json").absoluteFilePath());
+	if (file.open(QIODevice::WriteOnly | QIODevice::Text))
+		file.write(QJsonDocument(sidecar).toJson());
+	else
+		qWarning() << "could not write" << file.fileName();
 
-	return andVal/orVal;
+	return pageImgs[0];
 }
 
-QImage DkPageExtractionPlugin::drawPoly(const QSize & imgSize, const QPolygonF & poly) const {
+/**
+* Keeps the result cache below its limits before a batch adds new entries.
+**/
+void DkPageExtractionPlugin::preLoadPlugin() const {
 
-	QImage img(imgSize, QImage::Format_RGB888);
-	img.fill(QColor(0, 0, 0));
+	if (mUseCache)
+		mCache.prune();
+}
 
-	QPainter pg(&img);
-	pg.setBrush(QColor(255, 255, 255));
-	pg.drawPolygon(poly);
+void DkPageExtractionPlugin::loadSettings(QSettings & settings) {
 
-	return img;
+	settings.beginGroup(name());
+	int mIdx = settings.value("Method", mMethod).toInt();
+	if (mIdx >= 0 && mIdx < m_end)
+		mMethod = (MethodIndex)mIdx;
+	mUseCache = settings.value("UseCache", mUseCache).toBool();
+	mCacheMaxSizeMB = settings.value("CacheMaxSizeMB", mCacheMaxSizeMB).toInt();
+	mCacheMaxAgeDays = settings.value("CacheMaxAgeDays", mCacheMaxAgeDays).toInt();
+	mCache.setLimits((qint64)mCacheMaxSizeMB * 1024 * 1024, mCacheMaxAgeDays);
+
+	int pIdx = settings.value("Preset", mPreset).toInt();
+	if (pIdx >= 0 && pIdx < DkPageSegmentation::preset_end)
+		mPreset = (DkPageSegmentation::Preset)pIdx;
+
+	// every preset can be tuned in its own group
+	mSegmentation.setPreset(mPreset);
+	settings.beginGroup(presetName());
+	mSegmentation.loadSettings(settings);
+	settings.endGroup();
+
+	settings.endGroup();
 }
 
+void DkPageExtractionPlugin::saveSettings(QSettings & settings) const {
+
+	settings.beginGroup(name());
+	settings.setValue("Method", mMethod);
+	settings.setValue("UseCache", mUseCache);
+	settings.setValue("CacheMaxSizeMB", mCacheMaxSizeMB);
+	settings.setValue("CacheMaxAgeDays", mCacheMaxAgeDays);
+	settings.setValue("Preset", mPreset);
 
-};
+	settings.beginGroup(presetName());
+	mSegmentation.saveSettings(settings);
+	settings.endGroup();
+	settings.endGroup();
+}
+
+QString DkPageExtractionPlugin::presetName() const {
 
+	switch (mPreset) {
+	case DkPageSegmentation::preset_fast:
+		return "Fast";
+	default:
+		return "Default";
+	}
+}
+
+};
@@ -25,6 +25,8 @@
 #pragma once
 
 #include "DkPluginInterface.h"
+#include "DkPageCache.h"
+#include "DkPageSegmentation.h"
 
 namespace nmp {
 
@@ -49,13 +51,15 @@ public:
 		const nmc::DkSaveInfo& saveInfo,
 		QSharedPointer<nmc::DkBatchInfo>& batchInfo) const override;
 
-	virtual void preLoadPlugin() const {};	// is called before batch processing
+	virtual void preLoadPlugin() const;	// is called before batch processing
 	virtual void postLoadPlugin(const QVector<QSharedPointer<nmc::DkBatchInfo> > &) const {};	// is called after batch processing
 
 	enum {
 		id_crop_to_page,
 		id_crop_to_metadata,
 		id_draw_to_page,
+		id_rectify_page,
+		id_split_pages,
 		//id_eval_page,
 		// add actions here
 
@@ -80,10 +84,18 @@ protected:
 	QString mResultPath;
 
 	MethodIndex mMethod = m_thresholds;
+	bool mUseCache = true;
+	int mCacheMaxSizeMB = 64;		// <= 0 for no limit
+	int mCacheMaxAgeDays = 30;		// <= 0 for no limit
+	DkPageCache mCache;
 
-	QPolygonF readGT(const QString& imgPath) const;
-	double jaccardIndex(const QSize& imgSize, const QPolygonF& gt, const QPolygonF& computed) const;
-	QImage drawPoly(const QSize& imgSize, const QPolygonF& poly) const;
+	DkPageSegmentation::Preset mPreset = DkPageSegmentation::preset_default;
+	DkPageSegmentation mSegmentation;	// holds the parameters of all segmentations
+
+	QString presetName() const;
+
+	void segment(DkPageSegmentation& segM, QSharedPointer<nmc::DkImageContainer> imgC) const;
+	QImage splitPages(const QImage& img, const DkPageSegmentation& segM, const nmc::DkSaveInfo& saveInfo) const;
 };
 
 };
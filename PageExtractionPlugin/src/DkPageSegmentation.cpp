@@ -24,6 +24,7 @@
 
 #include "DkPageSegmentation.h"
 #include "DkPageSegmentationUtils.h"
+#include "DkImageBridge.h"
 #include "DkMath.h"	// nomacs
 
 #pragma warning(push, 0)	// no warnings from includes - begin
@@ -44,6 +45,112 @@ DkPageSegmentation::DkPageSegmentation(const cv::Mat& colImg /* = cv::Mat */, bo
 	this->mImg = colImg;
 }
 
+void DkPageSegmentation::setImage(const cv::Mat& colImg) {
+
+	mImg = colImg;
+	mRects.clear();
+	scale = 1.0f;
+}
+
+void DkPageSegmentation::setAlternativeMethod(bool alternativeMethod) {
+	this->alternativeMethod = alternativeMethod;
+}
+
+/**
+ * Resets all parameters to the values of preset.
+ * The fast preset trades accuracy for throughput.
+ **/
+void DkPageSegmentation::setPreset(Preset preset) {
+
+	// keep the image and results - only the parameters are reset
+	DkPageSegmentation defaults(mImg, alternativeMethod);
+	defaults.mRects = mRects;
+	*this = defaults;
+
+	if (preset == preset_fast) {
+		numThresh = 4;
+		mThumbWidth = 256.0f;
+		mMaxWidth = 640.0f;
+		mMaxHeightAlternative = 480.0f;
+	}
+}
+
+/**
+ * Loads the parameters from the current group of settings.
+ * Missing values keep their current value.
+ **/
+void DkPageSegmentation::loadSettings(QSettings& settings) {
+
+	thresh = settings.value("cannyThreshold", thresh).toInt();
+	numThresh = qMax(settings.value("numThresholds", numThresh).toInt(), 1);
+	mMinArea = settings.value("minArea", mMinArea).toDouble();
+	mMinAreaRel = settings.value("minAreaRel", mMinAreaRel).toDouble();
+	mMaxArea = settings.value("maxArea", mMaxArea).toDouble();
+	maxSide = settings.value("maxSide", maxSide).toFloat();
+	maxSideFactor = settings.value("maxSideFactor", maxSideFactor).toFloat();
+	looseDetection = settings.value("looseDetection", looseDetection).toBool();
+	mAdaptiveScale = settings.value("adaptiveScale", mAdaptiveScale).toBool();
+	mThumbWidth = settings.value("thumbWidth", mThumbWidth).toFloat();
+	mConfidentMaxCosine = settings.value("confidentMaxCosine", mConfidentMaxCosine).toDouble();
+	mConfidentAreaRatio = settings.value("confidentAreaRatio", mConfidentAreaRatio).toDouble();
+	mMaxWidth = settings.value("maxWidth", mMaxWidth).toFloat();
+	mMaxHeightAlternative = settings.value("maxHeightAlternative", mMaxHeightAlternative).toFloat();
+
+	settings.beginGroup("Alternative");
+	mExtractor.loadSettings(settings);
+	settings.endGroup();
+}
+
+void DkPageSegmentation::saveSettings(QSettings& settings) const {
+
+	settings.setValue("cannyThreshold", thresh);
+	settings.setValue("numThresholds", numThresh);
+	settings.setValue("minArea", mMinArea);
+	settings.setValue("minAreaRel", mMinAreaRel);
+	settings.setValue("maxArea", mMaxArea);
+	settings.setValue("maxSide", maxSide);
+	settings.setValue("maxSideFactor", maxSideFactor);
+	settings.setValue("looseDetection", looseDetection);
+	settings.setValue("adaptiveScale", mAdaptiveScale);
+	settings.setValue("thumbWidth", mThumbWidth);
+	settings.setValue("confidentMaxCosine", mConfidentMaxCosine);
+	settings.setValue("confidentAreaRatio", mConfidentAreaRatio);
+	settings.setValue("maxWidth", mMaxWidth);
+	settings.setValue("maxHeightAlternative", mMaxHeightAlternative);
+
+	settings.beginGroup("Alternative");
+	mExtractor.saveSettings(settings);
+	settings.endGroup();
+}
+
+/**
+ * Returns all parameters that influence the segmentation result (e.g. to identify cached results).
+ **/
+QByteArray DkPageSegmentation::parameterKey() const {
+
+	QString key = QString("%1;%2;%3;%4;%5;%6;%7;%8;%9")
+		.arg(alternativeMethod)
+		.arg(thresh)
+		.arg(numThresh)
+		.arg(mMinArea)
+		.arg(mMinAreaRel)
+		.arg(mMaxArea)
+		.arg(maxSide)
+		.arg(maxSideFactor)
+		.arg(scale);
+
+	key += QString(";%1;%2;%3;%4;%5;%6;%7;")
+		.arg(looseDetection)
+		.arg(mAdaptiveScale)
+		.arg(mThumbWidth)
+		.arg(mConfidentMaxCosine)
+		.arg(mConfidentAreaRatio)
+		.arg(mMaxWidth)
+		.arg(mMaxHeightAlternative);
+
+	return key.toLatin1() + mExtractor.parameterKey();
+}
+
 cv::Mat DkPageSegmentation::getDebugImg() const {
 
 	return dbgImg;	// is NULL if releaseDebug is DK_RELEASE_IMGS
@@ -78,51 +185,163 @@ QImage DkPageSegmentation::getCropped(const QImage & img) const {
 	return img;	// no document page found
 }
 
+QImage DkPageSegmentation::getCropped(const QImage & img, const DkPolyRect & rect) const {
+
+	return cropToRect(img, rect.toRotatingRect());
+}
+
+/**
+ * Returns all pages that do not overlap with a larger page (e.g. both pages of a book spread).
+ * Pages are sorted from left to right.
+ * @param maxOverlap maximal overlap relative to the smaller page
+ * @param minAreaRatio minimal area relative to the largest page
+ **/
+std::vector<DkPolyRect> DkPageSegmentation::getPages(float maxOverlap, float minAreaRatio) const {
+
+	std::vector<DkPolyRect> rects = mRects;
+	for (DkPolyRect& r : rects)
+		r.getArea();	// cache areas
+
+	std::sort(rects.rbegin(), rects.rend(), &DkPolyRect::compArea);	// rbegin() -> sort descending
+
+	std::vector<DkPolyRect> pages;
+	for (DkPolyRect& r : rects) {
+
+		double area = r.getArea();
+
+		if (!pages.empty() && area < pages[0].getArea() * minAreaRatio)
+			break;	// sorted -> all remaining rects are too small
+
+		bool overlaps = false;
+		for (DkPolyRect& p : pages) {
+
+			if (r.intersectArea(p) > maxOverlap * std::min(area, p.getArea())) {
+				overlaps = true;
+				break;
+			}
+		}
+
+		if (!overlaps)
+			pages.push_back(r);
+	}
+
+	std::sort(pages.begin(), pages.end(), [](const DkPolyRect& a, const DkPolyRect& b) {
+		return a.center().x < b.center().x;
+	});
+
+	return pages;
+}
+
+QImage DkPageSegmentation::getRectified(const QImage & img) const {
+
+	if (!mRects.empty())
+		return rectify(img, getMaxRect());
+
+	return img;	// no document page found
+}
+
+/**
+ * The minimal page area in full resolution pixels.
+ * It is the larger of the absolute (minArea) and the relative (minAreaRel * image area) setting.
+ **/
+double DkPageSegmentation::effectiveMinArea() const {
+	return qMax(mMinArea, mMinAreaRel * mImg.rows * mImg.cols);
+}
+
 void DkPageSegmentation::compute() {
 
 	cv::Mat lImg;
 	if (alternativeMethod) {
-		if (scale == 1.0f && mImg.rows > 700.0f)
-			scale = 700.0f / mImg.rows;
+		if (scale == 1.0f && mImg.rows > mMaxHeightAlternative)
+			scale = mMaxHeightAlternative / mImg.rows;
 			
 		lImg = findRectanglesAlternative(mImg, mRects);
-	} else {
-		cv::Mat imgLab;
-		
-		if (scale == 1.0f && 960.0f/mImg.cols < 0.8f)
-			scale = 960.0f/mImg.cols;
+	} 
+	else if (scale == 1.0f && mAdaptiveScale) {
+
+		// start with a thumbnail and only escalate to the working resolution if we are not confident
+		const float widths[] = { mThumbWidth, mMaxWidth };
+
+		for (float w : widths) {
+
+			scale = (w/mImg.cols < 0.8f) ? w/mImg.cols : 1.0f;
+
+			mRects.clear();
+			lImg = findRectangles(mImg, mRects);
+
+			if (scale == 1.0f || isConfident(mRects))
+				break;
+		}
+	}
+	else {
+		if (scale == 1.0f && mMaxWidth/mImg.cols < 0.8f)
+			scale = mMaxWidth/mImg.cols;
 			
-		cv::cvtColor(mImg, imgLab, CV_RGB2Lab);	// boost colors
 		lImg = findRectangles(mImg, mRects);
 	}
 
 	qDebug() << "[DkPageSegmentation] " << mRects.size() << " rectangles circles found resize factor: " << scale;
 }
 
+/**
+ * Returns true if the largest rectangle is (almost) rectangular and large enough to be a page.
+ **/
+bool DkPageSegmentation::isConfident(const std::vector<DkPolyRect>& rects) const {
+
+	const DkPolyRect* maxRect = 0;
+	double maxArea = 0;
+
+	for (const DkPolyRect& r : rects) {
+
+		double a = r.getAreaConst();
+		if (a > maxArea) {
+			maxArea = a;
+			maxRect = &r;
+		}
+	}
+
+	return maxRect && 
+		maxRect->getMaxCosine() < mConfidentMaxCosine &&
+		maxArea > mConfidentAreaRatio * mImg.rows * mImg.cols;
+}
+
 cv::Mat DkPageSegmentation::findRectangles(const cv::Mat& img, std::vector<DkPolyRect>& rects) const {
 	
-	cv::Mat tImg, gray;
+	// all buffers are owned by the thread's workspace, so batch processing does not allocate them per image
+	DkPageWorkspace& ws = DkPageWorkspace::local();
+	cv::Mat tImg;
 
-
-	if (scale != 1.0f)
-		cv::resize(img, tImg, cv::Size(), scale, scale, CV_INTER_AREA);	// inter nn -> assuming resize to be 1/(2^n)
+	if (scale != 1.0f) {
+		tImg = ws.mat(DkPageWorkspace::buf_resized, cv::Size(cvRound(img.cols*scale), cvRound(img.rows*scale)), img.type());
+		cv::resize(img, tImg, tImg.size(), 0, 0, CV_INTER_AREA);	// inter nn -> assuming resize to be 1/(2^n)
+	}
 	else
 		tImg = img;
 
-	std::vector<std::vector<cv::Point> > contours;
+	std::vector<std::vector<cv::Point> >& contours = ws.contours;
+	std::vector<std::vector<cv::Point> >& hull = ws.hull;
+	std::vector<cv::Point>& approx = ws.approx;
 
-	cv::Mat gray0(tImg.size(), CV_8UC1);
-	cv::Mat lImg(tImg.size(), CV_8UC1);
+	cv::Mat gray0 = ws.mat(DkPageWorkspace::buf_gray0, tImg.size(), CV_8UC1);
+	cv::Mat gray = ws.mat(DkPageWorkspace::buf_gray, tImg.size(), CV_8UC1);
+	cv::Mat lImg = ws.mat(DkPageWorkspace::buf_luminance, tImg.size(), CV_8UC1);
 
-	// find squares in every color plane of the image
-	for( int c = 0; c < 3; c++ ) {
+	// cheap bounds that reject small (text) contours before they are approximated:
+	// a polygon is contained in the bounding box of its contour and a quad with area A has a perimeter >= 4*sqrt(A)
+	const double minArea = effectiveMinArea()*scale*scale;
+	const double minPerimeter = 4.0*std::sqrt(minArea);
+
+	// find squares in every color plane of the image (grayscale images have one plane)
+	const int numPlanes = qMin(tImg.channels(), 3);
+
+	for( int c = 0; c < numPlanes; c++ ) {
 
 		int ch[] = {c, 0};
 		mixChannels(&tImg, 1, &gray0, 1, ch, 1);
 		cv::normalize(gray0, gray0, 255, 0, cv::NORM_MINMAX);
 
 		if (c == 0)	// back-up the luminance channel - we use it as precomputed image for the circle detection
-			lImg = gray0.clone();
+			gray0.copyTo(lImg);
 
 		int nT = numThresh;//(c == 0) ? numThresh*2 : numThresh;	// more luminance thresholds
 
@@ -141,30 +360,34 @@ cv::Mat DkPageSegmentation::findRectangles(const cv::Mat& img, std::vector<DkPol
 				//DkIP::imwrite("edgeImg.png", gray);
 			}
 			else {
-				gray = gray0 >= (l+1)*255/numThresh;
+				cv::compare(gray0, (l+1)*255/numThresh, gray, cv::CMP_GE);
 			}
 
 			// find contours and store them all as a list
 			findContours(gray, contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
 
+			// the hulls are swapped into contours so that both keep their capacity
 			if (looseDetection) {
-				std::vector<std::vector<cv::Point> > hull;
+				size_t numHulls = 0;
 				for (int i = 0; i < (int)contours.size(); i++) { 
 
+					if (cv::boundingRect(contours[i]).area() <= minArea)
+						continue;
+
 					double cArea = contourArea(cv::Mat(contours[i]));
 
-					if (fabs(cArea) > mMinArea*scale*scale && (!mMaxArea || fabs(cArea) < mMaxArea*(scale*scale))) {
-						std::vector<cv::Point> cHull;
-						cv::convexHull(cv::Mat(contours[i]), cHull, false);
-						hull.push_back(cHull);
+					if (fabs(cArea) > minArea && (!mMaxArea || fabs(cArea) < mMaxArea*(scale*scale))) {
+						if (hull.size() <= numHulls)
+							hull.resize(numHulls+1);
+						cv::convexHull(cv::Mat(contours[i]), hull[numHulls], false);
+						numHulls++;
 					}
 				}
 
-				contours = hull;
+				contours.swap(hull);
+				contours.resize(numHulls);
 			}
 
-			std::vector<cv::Point> approx;
-
 			// DEBUG ------------------------
 			//cv::Mat pImg = image.clone();
 			//cv::cvtColor(pImg, pImg, CV_Lab2RGB);
@@ -172,9 +395,20 @@ cv::Mat DkPageSegmentation::findRectangles(const cv::Mat& img, std::vector<DkPol
 
 			// test each contour
 			for( size_t i = 0; i < contours.size(); i++ ) {
+
+				const std::vector<cv::Point>& contour = contours[i];
+
+				if (contour.size() < 4 || cv::boundingRect(contour).area() <= minArea)
+					continue;
+
+				double perimeter = arcLength(contour, true);
+
+				if (perimeter < minPerimeter)
+					continue;
+
 				// approxicv::Mate contour with accuracy proportional
 				// to the contour perimeter
-				approxPolyDP(cv::Mat(contours[i]), approx, arcLength(cv::Mat(contours[i]), true)*0.02, true);
+				approxPolyDP(contour, approx, perimeter*0.02, true);
 
 				double cArea = contourArea(cv::Mat(approx));
 
@@ -190,7 +424,7 @@ cv::Mat DkPageSegmentation::findRectangles(const cv::Mat& img, std::vector<DkPol
 				// area may be positive or negative - in accordance with the
 				// contour orientation
 				if( approx.size() == 4 &&
-					fabs(cArea) > mMinArea*scale*scale &&
+					fabs(cArea) > minArea &&
 					(!mMaxArea || fabs(cArea) < mMaxArea*scale*scale) && 
 					isContourConvex(cv::Mat(approx)) ) {
 
@@ -231,16 +465,20 @@ cv::Mat DkPageSegmentation::findRectangles(const cv::Mat& img, std::vector<DkPol
 
 	rects = noLargeRects;
 
+	// lImg is a view into the workspace: it is valid until the next call on this thread
 	return lImg;
 }
 
 cv::Mat DkPageSegmentation::findRectanglesAlternative(const cv::Mat& img, std::vector<DkPolyRect>& rects) const {
-	PageExtractor extractor;
-	extractor.findPage(img, scale, rects);
+	mExtractor.findPage(img, scale, rects);
 
 	return img;
 }
 
+static void releaseImage(void* img) {
+	delete static_cast<QImage*>(img);
+}
+
 QImage DkPageSegmentation::cropToRect(const QImage & img, const nmc::DkRotatingRect & rect, const QColor & bgCol) const {
 	
 	QTransform tForm; 
@@ -255,30 +493,164 @@ QImage DkPageSegmentation::cropToRect(const QImage & img, const nmc::DkRotatingR
 	qDebug() << cImgSize;
 	qDebug() << "transform: " << tForm;
 
+	// OpenCV works on the image buffer directly - other formats are converted once
+	QImage src = img;
+	int numChannels = DkImageBridge::channels(src.format());
+	if (!numChannels) {
+		src = img.convertToFormat(QImage::Format_ARGB32);
+		numChannels = 4;
+	}
+
+	const QSize dstSize(qRound(cImgSize.x()), qRound(cImgSize.y()));
+
+	// axis-aligned pages with an integer offset are returned as a view on the source buffer
+	const double eps = 1e-6;
+	bool isTranslation = std::abs(tForm.m11() - 1.0) < eps && std::abs(tForm.m22() - 1.0) < eps &&
+		std::abs(tForm.m12()) < eps && std::abs(tForm.m21()) < eps;
+	QRect roi(qRound(-tForm.dx()), qRound(-tForm.dy()), dstSize.width(), dstSize.height());
+
+	if (isTranslation && 
+		std::abs(roi.x() + tForm.dx()) < eps && std::abs(roi.y() + tForm.dy()) < eps &&
+		src.rect().contains(roi)) {
+
+		const uchar* roiPtr = src.constBits() + (size_t)roi.y() * src.bytesPerLine() + (size_t)roi.x() * src.depth() / 8;
+
+		// QImage needs 32 bit aligned data and sub-byte pixels (mono) cannot be addressed
+		if (src.depth() < 8 || (size_t)roiPtr % 4 != 0)
+			return src.copy(roi);
+
+		// the view keeps a (shallow) copy of the source so its buffer lives as long as the view
+		// it is read-only, writing to it detaches (copies) the page
+		QImage* owner = new QImage(src);
+		QImage view(roiPtr, roi.width(), roi.height(), owner->bytesPerLine(), owner->format(), releaseImage, owner);
+		view.setColorTable(owner->colorTable());
+
+		return view;
+	}
+
 	double angle = nmc::DkMath::normAngleRad(rect.getAngle(), 0, CV_PI*0.5);
 	double minD = qMin(abs(angle), abs(angle-CV_PI*0.5));
 
-	QImage cImg = QImage(qRound(cImgSize.x()), qRound(cImgSize.y()), QImage::Format_ARGB32);
-	cImg.fill(bgCol.rgba());
+	// QPainter maps pixel areas, OpenCV maps pixel centers: u + 0.5 = T(x + 0.5)
+	cv::Mat M = (cv::Mat_<double>(2, 3) <<
+		tForm.m11(), tForm.m21(), tForm.dx() + 0.5 * (tForm.m11() + tForm.m21() - 1.0),
+		tForm.m12(), tForm.m22(), tForm.dy() + 0.5 * (tForm.m12() + tForm.m22() - 1.0));
 
-	// render the image into the new coordinate system
-	QPainter painter(&cImg);
-	painter.setWorldTransform(tForm);
+	// the destination keeps the source's pixel format
+	QImage cImg(dstSize, src.format());
+	cImg.setColorTable(src.colorTable());
 
-	// for rotated mRects we want perfect anti-aliasing
-	if (minD > FLT_EPSILON)
-		painter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
+	const cv::Mat srcMat(src.height(), src.width(), CV_8UC(numChannels), const_cast<uchar*>(src.constBits()), src.bytesPerLine());
+	cv::Mat dstMat = DkImageBridge::writableView(cImg);
 
-	painter.drawImage(QRect(QPoint(),img.size()), img, QRect(QPoint(), img.size()));
-	painter.end();
+	// for rotated rects we want perfect anti-aliasing (indexed images cannot be interpolated)
+	int interpolation = (minD > FLT_EPSILON && src.format() != QImage::Format_Indexed8) ? cv::INTER_LINEAR : cv::INTER_NEAREST;
+
+	// warpAffine is parallelized and only computes the destination pixels
+	cv::warpAffine(srcMat, dstMat, M, dstMat.size(), interpolation, cv::BORDER_CONSTANT, DkImageBridge::toScalar(bgCol, src.format()));
 
 	return cImg;
+}
+
+/**
+ * Warps the (perspective distorted) page to a rectangle.
+ * The homography is computed from the page corners, the output is rendered in strips
+ * so that only the remap coordinates of one strip per thread are kept in memory.
+ **/
+QImage DkPageSegmentation::rectify(const QImage & img, const DkPolyRect & rect, const QColor & bgCol) const {
+
+	std::vector<nmc::DkVector> pts = rect.getCorners();
+
+	if (pts.size() != 4)
+		return img;
 
-	//QImage dImg = mImg;
-	//QPainter p1(&dImg);
-	//p1.drawPolygon(rect.getPoly());
+	// order the corners clockwise (in image coordinates) starting with the top left corner
+	nmc::DkVector c = rect.center();
+	std::sort(pts.begin(), pts.end(), [&c](const nmc::DkVector& a, const nmc::DkVector& b) {
+		return std::atan2(a.y - c.y, a.x - c.x) < std::atan2(b.y - c.y, b.x - c.x);
+	});
 
-	//return dImg;
+	int tlIdx = 0;
+	for (int idx = 1; idx < 4; idx++) {
+		if (pts[idx].x + pts[idx].y < pts[tlIdx].x + pts[tlIdx].y)
+			tlIdx = idx;
+	}
+	std::rotate(pts.begin(), pts.begin() + tlIdx, pts.end());
+
+	const nmc::DkVector& tl = pts[0];
+	const nmc::DkVector& tr = pts[1];
+	const nmc::DkVector& br = pts[2];
+	const nmc::DkVector& bl = pts[3];
+
+	int width = qRound(qMax(nmc::DkVector(tr - tl).norm(), nmc::DkVector(br - bl).norm()));
+	int height = qRound(qMax(nmc::DkVector(bl - tl).norm(), nmc::DkVector(br - tr).norm()));
+
+	if (width < 1 || height < 1)
+		return img;
+
+	QImage src = img;
+	int numChannels = DkImageBridge::channels(src.format());
+	if (!numChannels || src.format() == QImage::Format_Indexed8) {
+		src = img.convertToFormat(QImage::Format_ARGB32);
+		numChannels = 4;
+	}
+
+	// maps destination to source coordinates
+	cv::Point2f dstPts[4] = { cv::Point2f(0, 0), cv::Point2f((float)width - 1, 0), cv::Point2f((float)width - 1, (float)height - 1), cv::Point2f(0, (float)height - 1) };
+	cv::Point2f srcPts[4] = { cv::Point2f(tl.x, tl.y), cv::Point2f(tr.x, tr.y), cv::Point2f(br.x, br.y), cv::Point2f(bl.x, bl.y) };
+	cv::Mat H = cv::getPerspectiveTransform(dstPts, srcPts);
+
+	double h[9];
+	for (int idx = 0; idx < 9; idx++)
+		h[idx] = H.at<double>(idx / 3, idx % 3);
+
+	QImage rImg(width, height, src.format());
+	const cv::Mat srcMat(src.height(), src.width(), CV_8UC(numChannels), const_cast<uchar*>(src.constBits()), src.bytesPerLine());
+	cv::Mat dstMat = DkImageBridge::writableView(rImg);
+	const cv::Scalar bg = DkImageBridge::toScalar(bgCol, src.format());
+
+	const int stripHeight = 64;
+	const int numStrips = (height + stripHeight - 1) / stripHeight;
+
+	cv::parallel_for_(cv::Range(0, numStrips), [&](const cv::Range& range) {
+
+		cv::Mat mapX, mapY;
+
+		for (int sIdx = range.start; sIdx < range.end; sIdx++) {
+
+			int y0 = sIdx * stripHeight;
+			int rows = qMin(stripHeight, height - y0);
+
+			mapX.create(rows, width, CV_32FC1);
+			mapY.create(rows, width, CV_32FC1);
+
+			for (int rIdx = 0; rIdx < rows; rIdx++) {
+
+				float* xPtr = mapX.ptr<float>(rIdx);
+				float* yPtr = mapY.ptr<float>(rIdx);
+				double y = y0 + rIdx;
+
+				// the homography is evaluated incrementally along the row
+				double sx = h[1] * y + h[2];
+				double sy = h[4] * y + h[5];
+				double sw = h[7] * y + h[8];
+
+				for (int cIdx = 0; cIdx < width; cIdx++) {
+					double w = 1.0 / sw;
+					xPtr[cIdx] = (float)(sx * w);
+					yPtr[cIdx] = (float)(sy * w);
+					sx += h[0];
+					sy += h[3];
+					sw += h[6];
+				}
+			}
+
+			cv::Mat dstStrip = dstMat.rowRange(y0, y0 + rows);
+			cv::remap(srcMat, dstStrip, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_CONSTANT, bg);
+		}
+	});
+
+	return rImg;
 }
 
 void DkPageSegmentation::filterDuplicates(float overlap, float areaRatio) {
@@ -288,52 +660,85 @@ void DkPageSegmentation::filterDuplicates(float overlap, float areaRatio) {
 
 void DkPageSegmentation::filterDuplicates(std::vector<DkPolyRect>& rects, float overlap, float areaRatio) const {
 
-	std::vector<int> delIdx;
+	// cache all areas, otherwise every comparison of the sort computes a polygon intersection
+	for (DkPolyRect& r : rects)
+		r.getArea();
+
 	std::sort(rects.rbegin(), rects.rend(), &DkPolyRect::compArea);	// rbegin() -> sort descending
 
-	for (int idx = 0; idx < (int)rects.size(); idx++) {
+	const int numRects = (int)rects.size();
+	std::vector<DkBox> boxes;
+	boxes.reserve(numRects);
+	for (const DkPolyRect& r : rects)
+		boxes.push_back(r.getBBox());
+
+	// sort & sweep: bounding boxes sorted by their left edge
+	std::vector<int> xOrder(numRects);
+	for (int idx = 0; idx < numRects; idx++)
+		xOrder[idx] = idx;
+	std::sort(xOrder.begin(), xOrder.end(), [&boxes](int a, int b) { return boxes[a].uc.x < boxes[b].uc.x; });
+
+	std::vector<float> lefts(numRects);
+	float maxWidth = 0;
+	for (int idx = 0; idx < numRects; idx++) {
+		lefts[idx] = boxes[xOrder[idx]].uc.x;
+		maxWidth = std::max(maxWidth, boxes[idx].getWidthF());
+	}
+
+	std::vector<bool> deleted(numRects, false);
+	std::vector<int> tmpDelIdx;
+	int numDeleted = 0;
+
+	for (int idx = 0; idx < numRects; idx++) {
 
 		// if we already deleted a rectangle, we can safely skip it
-		if (std::find(delIdx.begin(), delIdx.end(), idx) != delIdx.end())
+		if (deleted[idx])
 			continue;
 
 		DkPolyRect& cR = rects[idx];
+		const DkBox& cB = boxes[idx];
 		double cA = cR.getArea();
 
-		std::vector<int> tmpDelIdx;
+		tmpDelIdx.clear();
+
+		// only rectangles whose bounding boxes overlap can intersect
+		auto first = std::lower_bound(lefts.begin(), lefts.end(), cB.uc.x - maxWidth);
+		auto last = std::upper_bound(lefts.begin(), lefts.end(), cB.lc.x);
 
-		for (int oIdx = idx+1; oIdx < (int)rects.size(); oIdx++) {
+		// NOTE: the candidate order does not matter since deletions are only applied after this loop
+		for (auto it = first; it != last; it++) {
+
+			int oIdx = xOrder[it - lefts.begin()];
 
 			// if we already deleted a rectangle, we can safely skip it
-			if (idx == oIdx || std::find(delIdx.begin(), delIdx.end(), oIdx) != delIdx.end())
+			if (oIdx <= idx || deleted[oIdx])
+				continue;
+
+			const DkBox& oB = boxes[oIdx];
+			if (oB.lc.x < cB.uc.x || oB.lc.y < cB.uc.y || oB.uc.y > cB.lc.y)
 				continue;
 
 			DkPolyRect& oR = rects[oIdx];
 			double oA = oR.getArea();
 
 			// ignore rectangles with totally different area
-			if (oA/cA < areaRatio)	// since we sort, we know that oA is larger
+			if (oA/cA < areaRatio)	// since we sort, we know that oA is smaller
 				continue;
 
-			double intersection = abs(oR.intersectArea(cR));
-
-			if (std::max(intersection/cR.getArea(), intersection/oR.getArea()) > overlap) {
+			// the intersection is at most the intersection of the bounding boxes
+			double bboxIntersection = (double)(std::min(cB.lc.x, oB.lc.x) - std::max(cB.uc.x, oB.uc.x)) *
+				(std::min(cB.lc.y, oB.lc.y) - std::max(cB.uc.y, oB.uc.y));
+			if (bboxIntersection < 0.999 * overlap * std::min(cA, oA))	// 0.999 -> tolerance for the approximated polygon intersection
+				continue;
 
-				double cVal, oVal;
+			double intersection = abs(oR.intersectArea(cR));
 
-				// if the cosine is more or less the same, take the larger rectangle
-				//if (fabs(cR.getMaxCosine() - oR.getMaxCosine()) < 0.02) {
-				//	cVal = oA;	// inverse since we want to prefer larger areas
-				//	oVal = cA;
-				//}
-				//else {
-				cVal = cR.getMaxCosine();
-				oVal = oR.getMaxCosine();
-				//}
+			if (std::max(intersection/cA, intersection/oA) > overlap) {
 
 				// delete the rect which has an inferior cosine value
-				if (cVal > oVal) {
-					delIdx.push_back(idx);
+				if (cR.getMaxCosine() > oR.getMaxCosine()) {
+					deleted[idx] = true;
+					numDeleted++;
 					tmpDelIdx.clear();
 					break; // we're done if we delete the current rect
 				}
@@ -343,15 +748,18 @@ void DkPageSegmentation::filterDuplicates(std::vector<DkPolyRect>& rects, float
 			}
 		}
 
-		delIdx.insert(delIdx.end(), tmpDelIdx.begin(), tmpDelIdx.end());
+		for (int dIdx : tmpDelIdx)
+			deleted[dIdx] = true;
+		numDeleted += (int)tmpDelIdx.size();
 	}
 
-	if (!delIdx.empty()) {
+	if (numDeleted > 0) {
 		std::vector<DkPolyRect> filtered;
+		filtered.reserve(numRects - numDeleted);
 
-		for (int idx = 0; idx < (int)rects.size(); idx++) {
+		for (int idx = 0; idx < numRects; idx++) {
 
-			if (std::find(delIdx.begin(), delIdx.end(), idx) == delIdx.end())
+			if (!deleted[idx])
 				filtered.push_back(rects[idx]);
 		}
 
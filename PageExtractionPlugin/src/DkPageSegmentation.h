@@ -30,8 +30,10 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc_c.h>
 
+#include <QByteArray>
 #include <QColor>
 #include <QImage>
+#include <QSettings>
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmp {
@@ -43,19 +45,38 @@ class DkPageSegmentation {
 public:
 	DkPageSegmentation(const cv::Mat& colImg = cv::Mat(), bool alternativeMethod = false);
 
+	enum Preset {
+		preset_default = 0,
+		preset_fast,		// fewer thresholds and lower resolution
+
+		preset_end
+	};
+
+	void setImage(const cv::Mat& colImg);
+	void setAlternativeMethod(bool alternativeMethod);
+	void setPreset(Preset preset);
+	void loadSettings(QSettings& settings);
+	void saveSettings(QSettings& settings) const;
+
 	virtual void compute();
 	virtual void filterDuplicates(float overlap = 0.6f, float areaRatio = 0.5f);
 	virtual void filterDuplicates(std::vector<DkPolyRect>& rects, float overlap = 0.6f, float areaRatio = 0.1f) const;
 
 	virtual std::vector<DkPolyRect> getRects() const { return mRects; };
+	virtual void setRects(const std::vector<DkPolyRect>& rects) { mRects = rects; };
+	QByteArray parameterKey() const;
 	virtual cv::Mat getDebugImg() const;
 	virtual QImage getCropped(const QImage& img) const;
+	virtual QImage getCropped(const QImage& img, const DkPolyRect& rect) const;
+	virtual QImage getRectified(const QImage& img) const;
+	virtual std::vector<DkPolyRect> getPages(float maxOverlap = 0.1f, float minAreaRatio = 0.3f) const;
 	virtual void draw(cv::Mat& img, const cv::Scalar& col = cv::Scalar(255, 222, 0)) const;
 	virtual void draw(QImage& img, const QColor& col = QColor(255, 222, 0)) const;
 	virtual void draw(cv::Mat& img, const std::vector<DkPolyRect>& rects, const cv::Scalar& col = cv::Scalar(255, 222, 0)) const;
 	DkPolyRect getMaxRect() const;
+	double effectiveMinArea() const;
 
-	bool looseDetection;
+	bool looseDetection = true;
 
 protected:
 	cv::Mat mImg;
@@ -64,17 +85,29 @@ protected:
 	int thresh = 80;
 	int numThresh = 10;
 	double mMinArea = 12000;
+	double mMinAreaRel = 0.001;		// minimal area relative to the image area (the larger of both is used)
 	double mMaxArea = 0;
 	float maxSide = 0;
 	float maxSideFactor = 0.97f;
 	float scale = 1.0f;
+	float mMaxWidth = 960.0f;			// working resolution of the thresholds method
+	float mMaxHeightAlternative = 700.0f;	// working resolution of the alternative method
 	bool alternativeMethod;
+	PageExtractor mExtractor;		// alternative method
+
+	// adaptive resolution (thresholds method only)
+	bool mAdaptiveScale = true;
+	float mThumbWidth = 320.0f;
+	double mConfidentMaxCosine = 0.1;	// the thumbnail result is kept if the page's max cosine is below
+	double mConfidentAreaRatio = 0.2;	// and it covers at least this image fraction
 
 	std::vector<DkPolyRect> mRects;
 
 	virtual cv::Mat findRectangles(const cv::Mat& img, std::vector<DkPolyRect>& squares) const;
 	virtual cv::Mat findRectanglesAlternative(const cv::Mat& img, std::vector<DkPolyRect>& squares) const;
+	bool isConfident(const std::vector<DkPolyRect>& rects) const;
 	QImage cropToRect(const QImage& img, const nmc::DkRotatingRect& rect, const QColor& bgCol = QColor(0,0,0)) const;
+	QImage rectify(const QImage& img, const DkPolyRect& rect, const QColor& bgCol = QColor(0,0,0)) const;
 	void drawRects(QPainter* p, const std::vector<DkPolyRect>& rects, const QColor& col = QColor(100, 100, 100)) const;
 };
 
@@ -37,7 +37,7 @@ namespace nmp {
 // DkIntersectPoly --------------------------------------------------------------------
 DkIntersectPoly::DkIntersectPoly() {};
 
-DkIntersectPoly::DkIntersectPoly(std::vector<nmc::DkVector> vecA, std::vector<nmc::DkVector> vecB) {
+DkIntersectPoly::DkIntersectPoly(const std::vector<nmc::DkVector>& vecA, const std::vector<nmc::DkVector>& vecB) {
 
 	this->vecA = vecA;
 	this->vecB = vecB;
@@ -115,7 +115,7 @@ double DkIntersectPoly::compute() {
 
 }
 
-void DkIntersectPoly::inness(std::vector<DkVertex> ipA, std::vector<DkVertex> ipB) {
+void DkIntersectPoly::inness(const std::vector<DkVertex>& ipA, const std::vector<DkVertex>& ipB) {
 
 	int s = 0;
 
@@ -137,7 +137,7 @@ void DkIntersectPoly::inness(std::vector<DkVertex> ipA, std::vector<DkVertex> ip
 
 };
 
-void DkIntersectPoly::cross(DkVertex a, DkVertex b, DkVertex c, DkVertex d, double a1, double a2, double a3, double a4) {
+void DkIntersectPoly::cross(const DkVertex& a, const DkVertex& b, const DkVertex& c, const DkVertex& d, double a1, double a2, double a3, double a4) {
 
 	double r1 = a1 / ((double)a1 + a2 + DBL_EPSILON);
 	double r2 = a3 / ((double)a3 + a4 + DBL_EPSILON);
@@ -199,7 +199,7 @@ void DkIntersectPoly::getVertices(const std::vector<nmc::DkVector>& vec, std::ve
 	}
 };
 
-void DkIntersectPoly::computeBoundingBox(std::vector<nmc::DkVector> vec, nmc::DkVector *minRange, nmc::DkVector *maxRange) {
+void DkIntersectPoly::computeBoundingBox(const std::vector<nmc::DkVector>& vec, nmc::DkVector *minRange, nmc::DkVector *maxRange) {
 
 
 	for (unsigned int idx = 0; idx < vec.size(); idx++) {
@@ -209,6 +209,117 @@ void DkIntersectPoly::computeBoundingBox(std::vector<nmc::DkVector> vec, nmc::Dk
 	}
 };
 
+// convex quad intersection --------------------------------------------------------------------
+// Sutherland-Hodgman clipping on fixed size arrays, used for the (convex) page candidates
+static const int maxClipVertices = 16;	// a clip step at most doubles the vertices
+
+/**
+ * Returns true if the 4 points form a convex (non-degenerated) quadrilateral.
+ */
+static bool isConvexQuad(const std::vector<nmc::DkVector>& pts) {
+
+	if (pts.size() != 4)
+		return false;
+
+	int numPos = 0, numNeg = 0;
+
+	for (int idx = 0; idx < 4; idx++) {
+
+		const nmc::DkVector& p0 = pts[idx];
+		const nmc::DkVector& p1 = pts[(idx + 1) & 3];
+		const nmc::DkVector& p2 = pts[(idx + 2) & 3];
+
+		float c = (p1.x - p0.x) * (p2.y - p1.y) - (p1.y - p0.y) * (p2.x - p1.x);
+		numPos += c > 0;
+		numNeg += c < 0;
+	}
+
+	return numPos == 0 ? numNeg > 0 : numNeg == 0;
+}
+
+/**
+ * Clips the convex polygon (x, y) with n vertices against the inner side of the edge (ax, ay) -> (bx, by).
+ * orientation is +1 or -1 depending on the clip polygon's winding order.
+ * @return the number of vertices written to (ox, oy)
+ */
+static int clipPolygon(const float* x, const float* y, int n, float ax, float ay, float bx, float by, float orientation, float* ox, float* oy) {
+
+	float ex = (bx - ax) * orientation;
+	float ey = (by - ay) * orientation;
+
+	// signed distances (times the edge length) - this loop vectorizes
+	float d[maxClipVertices];
+	for (int idx = 0; idx < n; idx++)
+		d[idx] = ex * (y[idx] - ay) - ey * (x[idx] - ax);
+
+	int m = 0;
+	for (int idx = 0, pIdx = n - 1; idx < n; pIdx = idx++) {
+
+		bool inCur = d[idx] >= 0;
+		bool inPrev = d[pIdx] >= 0;
+
+		if (inCur != inPrev) {
+			float t = d[pIdx] / (d[pIdx] - d[idx]);
+			ox[m] = x[pIdx] + t * (x[idx] - x[pIdx]);
+			oy[m] = y[pIdx] + t * (y[idx] - y[pIdx]);
+			m++;
+		}
+		if (inCur) {
+			ox[m] = x[idx];
+			oy[m] = y[idx];
+			m++;
+		}
+	}
+
+	return m;
+}
+
+/**
+ * Computes the intersection area of two convex quadrilaterals.
+ * @return false if the fast path cannot be used (e.g. non-convex polygons)
+ **/
+static bool convexQuadIntersection(const std::vector<nmc::DkVector>& ptsA, const std::vector<nmc::DkVector>& ptsB, double& area) {
+
+	if (!isConvexQuad(ptsA) || !isConvexQuad(ptsB))
+		return false;
+
+	area = 0;
+
+	float x[2][maxClipVertices];
+	float y[2][maxClipVertices];
+	int n = 4;
+
+	float orientation = 0;
+	for (int idx = 0; idx < 4; idx++) {
+		x[0][idx] = ptsA[idx].x;
+		y[0][idx] = ptsA[idx].y;
+		orientation += ptsB[idx].x * ptsB[(idx + 1) & 3].y - ptsB[(idx + 1) & 3].x * ptsB[idx].y;
+	}
+	orientation = orientation < 0 ? -1.0f : 1.0f;
+
+	int cur = 0;
+	for (int idx = 0; idx < 4 && n > 0; idx++) {
+
+		const nmc::DkVector& a = ptsB[idx];
+		const nmc::DkVector& b = ptsB[(idx + 1) & 3];
+
+		n = clipPolygon(x[cur], y[cur], n, a.x, a.y, b.x, b.y, orientation, x[1 - cur], y[1 - cur]);
+		cur = 1 - cur;
+
+		// numerical issues - let the general implementation handle it
+		if (n > maxClipVertices / 2)
+			return false;
+	}
+
+	// shoelace formula
+	for (int idx = 0, pIdx = n - 1; idx < n; pIdx = idx++)
+		area += (double)x[cur][pIdx] * y[cur][idx] - (double)x[cur][idx] * y[cur][pIdx];
+
+	area = std::abs(area) * 0.5;
+
+	return true;
+}
+
 // DkPolyRect --------------------------------------------------------------------
 DkPolyRect::DkPolyRect(const std::vector<cv::Point>& pts) {
 
@@ -233,25 +344,60 @@ void DkPolyRect::toDkVectors(const std::vector<cv::Point>& pts, std::vector<nmc:
 		dkPts.push_back(nmc::DkVector(pts.at(idx)));
 }
 
+/**
+ * Computes the maximal absolute cosine of all corner angles.
+ * Every edge vector and its squared length are computed once and the
+ * squared cosines are compared so that only a single sqrt is needed.
+ **/
 void DkPolyRect::computeMaxCosine() {
 
 	maxCosine = 0;
 
-	for (int idx = 2; idx < (int)mPts.size()+2; idx++ ) {
+	const int n = (int)mPts.size();
+	if (n < 3)
+		return;
+
+	// edge entering the first corner
+	double ex = mPts[0].x - mPts[n-1].x;
+	double ey = mPts[0].y - mPts[n-1].y;
+	double eNorm = ex*ex + ey*ey;
+	double maxCos2 = 0;
+
+	for (int idx = 0; idx < n; idx++) {
+
+		const nmc::DkVector& c = mPts[idx];
+		const nmc::DkVector& c1 = mPts[idx+1 < n ? idx+1 : 0];
 
-		nmc::DkVector& c = mPts[(idx-1)%mPts.size()];	// current corner;
-		nmc::DkVector& c1 = mPts[idx%mPts.size()];
-		nmc::DkVector& c2 = mPts[idx-2];
+		double nx = c1.x - c.x;
+		double ny = c1.y - c.y;
+		double nNorm = nx*nx + ny*ny;
 
-		double cosine = abs((c1-c).cosv(c2-c));
+		// cos^2 of the angle between both edges - degenerated corners are ignored
+		double dot = ex*nx + ey*ny;
+		double denom = eNorm*nNorm;
+		double cos2 = denom > 0 ? dot*dot/denom : 0.0;
 
-		maxCosine = std::max(maxCosine, cosine);
+		maxCos2 = std::max(maxCos2, cos2);
+
+		ex = nx;
+		ey = ny;
+		eNorm = nNorm;
 	}
+
+	maxCosine = std::sqrt(maxCos2);
 }
 
+/**
+ * Returns the area of the intersection with pr.
+ * Convex quads (all page candidates) are clipped directly, the general polygon intersection is the fallback.
+ **/
 double DkPolyRect::intersectArea(const DkPolyRect& pr) const {
 
-	return DkIntersectPoly(mPts, pr.mPts).compute();
+	double area = 0;
+	if (convexQuadIntersection(mPts, pr.mPts, area))
+		return area;
+
+	return std::abs(DkIntersectPoly(mPts, pr.mPts).compute());
 }
 
 void DkPolyRect::scale(float s) {
@@ -427,25 +573,301 @@ QPolygonF DkPolyRect::toPolygon() const {
 	return poly;
 }
 
-void PageExtractor::findPage(cv::Mat img, float scale, std::vector<DkPolyRect>& rects) {
-	cv::Mat gray, bw;
+// DkBitImage --------------------------------------------------------------------
+/**
+ * Resizes the image to rows x cols and clears all bits.
+ * The storage only grows.
+ **/
+void DkBitImage::create(int rows, int cols) {
+
+	mRows = rows;
+	mCols = cols;
+	mWords = (cols + 63) / 64;
+	mBits.assign((size_t)mRows * mWords, 0);
+}
+
+/**
+ * Unpacks the image to a CV_8UC1 image with 0 and 255 (e.g. for debugging).
+ **/
+void DkBitImage::toMat(cv::Mat& img) const {
+
+	img.create(mRows, mCols, CV_8UC1);
+
+	for (int rIdx = 0; rIdx < mRows; rIdx++) {
+
+		const std::uint64_t* bPtr = row(rIdx);
+		unsigned char* iPtr = img.ptr<unsigned char>(rIdx);
+
+		for (int cIdx = 0; cIdx < mCols; cIdx++)
+			iPtr[cIdx] = test(bPtr, cIdx) ? 255 : 0;
+	}
+}
+
+std::uint64_t DkBitImage::tailMask() const {
+
+	int tailBits = mCols & 63;
+	return tailBits ? (std::uint64_t(1) << tailBits) - 1 : ~std::uint64_t(0);
+}
+
+/**
+ * Splits the structuring element into horizontal runs relative to its (centered) anchor.
+ **/
+std::vector<DkBitImage::Run> DkBitImage::runs(const cv::Mat& selem) {
+
+	std::vector<Run> seRuns;
+	const int ax = selem.cols / 2;
+	const int ay = selem.rows / 2;
+
+	for (int rIdx = 0; rIdx < selem.rows; rIdx++) {
+
+		const unsigned char* sPtr = selem.ptr<unsigned char>(rIdx);
+
+		for (int cIdx = 0; cIdx < selem.cols; cIdx++) {
+
+			if (!sPtr[cIdx])
+				continue;
+
+			int end = cIdx;
+			while (end + 1 < selem.cols && sPtr[end + 1])
+				end++;
+
+			Run r = { rIdx - ay, cIdx - ax, end - ax };
+			seRuns.push_back(r);
+			cIdx = end;
+		}
+	}
+
+	return seRuns;
+}
+
+/**
+ * Returns word w of a row whose pixels are shifted by s: pixel x of the result is pixel x+s of src.
+ **/
+static inline std::uint64_t shiftedWord(const std::uint64_t* src, int numWords, int w, int s) {
+
+	const int ws = s >= 0 ? s / 64 : -((63 - s) / 64);	// floor(s / 64)
+	const int bs = s - ws * 64;
+	const int idx = w + ws;
+
+	std::uint64_t lo = (idx >= 0 && idx < numWords) ? src[idx] : 0;
+	if (!bs)
+		return lo;
+
+	std::uint64_t hi = (idx + 1 >= 0 && idx + 1 < numWords) ? src[idx + 1] : 0;
+
+	return (lo >> bs) | (hi << (64 - bs));
+}
+
+/**
+ * Computes tmp[x] = or(src[x] ... src[x+n]) (forward) or tmp[x] = or(src[x-n] ... src[x]) with
+ * log2(n+1) shift-ors (doubling the span). Only pixels inside the row are read, so nothing is lost
+ * at the row borders.
+ **/
+static void spanOr(const std::uint64_t* src, std::uint64_t* tmp, int numWords, int n, bool forward) {
+
+	std::copy(src, src + numWords, tmp);
+
+	for (int span = 1; span <= n;) {
+
+		const int s = std::min(span, n + 1 - span);
+
+		// in-place is fine since only words that were not written yet are read
+		if (forward) {
+			for (int w = 0; w < numWords; w++)
+				tmp[w] |= shiftedWord(tmp, numWords, w, s);
+		}
+		else {
+			for (int w = numWords - 1; w >= 0; w--)
+				tmp[w] |= shiftedWord(tmp, numWords, w, -s);
+		}
+
+		span += s;
+	}
+}
+
+/**
+ * Computes row r of the dilation with the runs of a structuring element.
+ * @param dst the dilated row (wordsPerRow() words)
+ * @param tmp a buffer with wordsPerRow() words
+ **/
+void DkBitImage::dilateRow(const std::vector<Run>& seRuns, int r, std::uint64_t* dst, std::uint64_t* tmp) const {
+
+	std::fill(dst, dst + mWords, std::uint64_t(0));
+
+	for (const Run& run : seRuns) {
+
+		const int sr = r + run.dy;
+		if (sr < 0 || sr >= mRows)
+			continue;
+
+		const std::uint64_t* src = row(sr);
+
+		// dst[x] |= or(src[x+l] ... src[x+r])
+		if (run.l <= 0 && run.r >= 0) {
+
+			spanOr(src, tmp, mWords, run.r, true);
+			for (int w = 0; w < mWords; w++)
+				dst[w] |= tmp[w];
+
+			spanOr(src, tmp, mWords, -run.l, false);
+			for (int w = 0; w < mWords; w++)
+				dst[w] |= tmp[w];
+		}
+		else {
+			// the run does not contain the anchor: compute it at the border closest to x and shift it
+			const bool forward = run.l > 0;
+			spanOr(src, tmp, mWords, run.r - run.l, forward);
+
+			const int shift = forward ? run.l : run.r;
+			for (int w = 0; w < mWords; w++)
+				dst[w] |= shiftedWord(tmp, mWords, w, shift);
+		}
+	}
+
+	if (mWords > 0)
+		dst[mWords - 1] &= tailMask();
+}
+
+/**
+ * Dilates the image with selem (the anchor is the center of selem).
+ * Pixels outside the image are 0, this equals cv::dilate with its default border.
+ **/
+void DkBitImage::dilate(const cv::Mat& selem, DkBitImage& dst) const {
+
+	dst.create(mRows, mCols);
+	std::vector<Run> seRuns = runs(selem);
+
+	cv::parallel_for_(cv::Range(0, mRows), [&](const cv::Range& range) {
+
+		std::vector<std::uint64_t> tmp(mWords);
+
+		for (int rIdx = range.start; rIdx < range.end; rIdx++)
+			dilateRow(seRuns, rIdx, dst.row(rIdx), tmp.data());
+	});
+}
+
+// DkPageWorkspace --------------------------------------------------------------------
+/**
+ * Returns the workspace of the calling thread.
+ **/
+DkPageWorkspace& DkPageWorkspace::local() {
+
+	static thread_local DkPageWorkspace ws;
+	return ws;
+}
+
+/**
+ * Returns a size x type view of the buffer slot.
+ * The slot is only reallocated if it is too small for the requested size.
+ * Note: the content is undefined.
+ **/
+cv::Mat DkPageWorkspace::mat(Buffer slot, const cv::Size& size, int type) {
+
+	size_t numBytes = (size_t)size.area() * CV_ELEM_SIZE(type);
+	cv::Mat& buf = mBuffers[slot];
+
+	if (buf.total() < numBytes)
+		buf.create(1, (int)numBytes, CV_8UC1);
+
+	return cv::Mat(size, type, buf.data);
+}
+
+/**
+ * Returns the number of bytes currently allocated by this workspace.
+ **/
+size_t DkPageWorkspace::bytes() const {
+
+	size_t numBytes = 0;
+	for (const cv::Mat& buf : mBuffers)
+		numBytes += buf.total();
+
+	for (const DkBitImage& p : planes)
+		numBytes += p.bytes();
+
+	numBytes += edges.bytes() + text.bytes() + bw.bytes();
+
+	return numBytes;
+}
+
+// PageExtractor --------------------------------------------------------------------
+void PageExtractor::loadSettings(QSettings& settings) {
+
+	maxLinesHough = settings.value("maxLinesHough", maxLinesHough).toInt();
+	houghPeakThresholdRel = settings.value("houghPeakThresholdRel", houghPeakThresholdRel).toFloat();
+	t_theta = settings.value("parallelTolerance", t_theta).toDouble();
+	t_l = settings.value("lengthTolerance", t_l).toFloat();
+	maxGapLengthRel = settings.value("maxGapLengthRel", maxGapLengthRel).toFloat();
+	minLineSegmentLength = settings.value("minLineSegmentLength", minLineSegmentLength).toInt();
+	minRelSideLength = settings.value("minRelSideLength", minRelSideLength).toFloat();
+	orthoTol = settings.value("orthogonalTolerance", orthoTol).toDouble();
+	cornerGapTol = settings.value("cornerGapTolerance", cornerGapTol).toFloat();
+	numFinalRects = qMax(settings.value("numFinalRects", numFinalRects).toInt(), 1);
+}
+
+void PageExtractor::saveSettings(QSettings& settings) const {
+
+	settings.setValue("maxLinesHough", maxLinesHough);
+	settings.setValue("houghPeakThresholdRel", houghPeakThresholdRel);
+	settings.setValue("parallelTolerance", t_theta);
+	settings.setValue("lengthTolerance", t_l);
+	settings.setValue("maxGapLengthRel", maxGapLengthRel);
+	settings.setValue("minLineSegmentLength", minLineSegmentLength);
+	settings.setValue("minRelSideLength", minRelSideLength);
+	settings.setValue("orthogonalTolerance", orthoTol);
+	settings.setValue("cornerGapTolerance", cornerGapTol);
+	settings.setValue("numFinalRects", numFinalRects);
+}
+
+/**
+ * Returns all parameters that influence the result of findPage.
+ **/
+QByteArray PageExtractor::parameterKey() const {
+
+	QString key = QString("%1;%2;%3;%4;%5;%6;%7;%8;%9")
+		.arg(maxLinesHough)
+		.arg(houghPeakThresholdRel)
+		.arg(t_theta)
+		.arg(t_l)
+		.arg(maxGapLengthRel)
+		.arg(minLineSegmentLength)
+		.arg(minRelSideLength)
+		.arg(orthoTol)
+		.arg(cornerGapTol);
+
+	key += QString(";%1").arg(numFinalRects);
+
+	return key.toLatin1();
+}
+
+void PageExtractor::findPage(cv::Mat img, float scale, std::vector<DkPolyRect>& rects) const {
+
+	DkPageWorkspace& ws = DkPageWorkspace::local();
+
+	cv::Mat gray = ws.mat(DkPageWorkspace::buf_gray0, img.size(), CV_8UC1);
+	if (img.channels() == 1)
+		img.copyTo(gray);
+	else
+		cv::cvtColor(img, gray, CV_RGB2GRAY);
 
-	cv::cvtColor(img, gray, CV_RGB2GRAY);
 	if (scale != 1.0f) {
-		cv::resize(gray, gray, cv::Size(), scale, scale, CV_INTER_AREA);	// inter nn -> assuming resize to be 1/(2^n)
+		cv::Mat sGray = ws.mat(DkPageWorkspace::buf_gray, cv::Size(cvRound(img.cols*scale), cvRound(img.rows*scale)), CV_8UC1);
+		cv::resize(gray, sGray, sGray.size(), 0, 0, CV_INTER_AREA);	// inter nn -> assuming resize to be 1/(2^n)
+		gray = sGray;
 	}
 	const int smallerSide = std::min(gray.size().width, gray.size().height);
 	
 	cv::equalizeHist(gray, gray);
-	bw = removeText(gray, 2.0f, 5, 2);
-//	cv::imshow("bw after removeText", bw);
+	const DkBitImage& text = removeText(gray, 2.0f, 5, 2, ws);
+//	cv::Mat dbgText;
+//	text.toMat(dbgText);
+//	cv::imshow("bw after removeText", dbgText);
 //	cv::waitKey(0);
 	
-	cv::dilate(bw, bw, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3)));
+	DkBitImage& bw = ws.bw;
+	text.dilate(cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3)), bw);
 	
-	cv::Mat lineImg;
-	int accMin = (int)(houghPeakThresholdRel * std::min(bw.size().width, bw.size().height));
-	std::vector<HoughLine> lines = houghTransform(bw, 1, (float)(CV_PI / 180.0), accMin, maxLinesHough);
+	int accMin = (int)(houghPeakThresholdRel * std::min(bw.cols(), bw.rows()));
+	std::vector<HoughLine> lines = houghTransform(bw, 1, (float)(CV_PI / 180.0), accMin, maxLinesHough, ws);
 	if (lines.empty()) {
 		qDebug() << "no hough lines detected";
 		return;
@@ -454,22 +876,46 @@ void PageExtractor::findPage(cv::Mat img, float scale, std::vector<DkPolyRect>&
 	// find line segments in image
 	int maxGapLength = (int)(maxGapLengthRel * smallerSide);
 	std::vector<LineSegment> lineSegments = findLineSegments(bw, lines, minLineSegmentLength, maxGapLength);
-	if (lineSegments.empty()) {
+
+	// lines without a line segment are ignored
+	// the remaining lines are sorted by angle so that only lines within t_theta need to be paired
+	std::vector<int> lineOrder;
+	lineOrder.reserve(lines.size());
+	for (int i = 0; i < (int)lines.size(); i++) {
+		if (lineSegments[i].length > 0)
+			lineOrder.push_back(i);
+	}
+	if (lineOrder.empty()) {
 		qDebug() << "findLineSegments has not found any line segments, even though hough lines were detected.";
 		return;
 	}
-	
+	std::sort(lineOrder.begin(), lineOrder.end(), [&lines] (int a, int b) { return lines[a].angle < lines[b].angle; });
+	const int numLines = (int)lineOrder.size();
+
 	// 4.3 transform domain peak filtering
-	// iterate through all pairs of lines and build pairs of parallel line segments called extended peak pairs (EPs)
+	// build pairs of parallel line segments called extended peak pairs (EPs)
 	std::vector<ExtendedPeak> EPs;
-	for (size_t i = 0; i < lines.size() - 1; i++) {
-		for (size_t j = i + 1; j < lines.size(); j++) {
+	for (int p = 0; p < numLines; p++) {
+		const HoughLine& li = lines[lineOrder[p]];
+
+		// walk forward (wrapping at pi) until the angles are too far apart
+		for (int k = 1; k < numLines; k++) {
+			int q = (p + k) % numLines;
+			const HoughLine& lj = lines[lineOrder[q]];
+			double d = lj.angle - li.angle + (q < p ? CV_PI : 0.0);
+
+			if (d >= t_theta)
+				break;
+
 			// test for parallelity
-			if (angleDiff(lines[i].angle, lines[j].angle) < t_theta && 
-					std::abs(lines[i].acc - lines[j].acc) < t_l * 0.5 * (lines[i].acc + lines[j].acc)) {
-				
+			if (angleDiff(li.angle, lj.angle) < t_theta &&
+					std::abs(li.acc - lj.acc) < t_l * 0.5 * (li.acc + lj.acc)) {
+
+				int i = std::min(lineOrder[p], lineOrder[q]);
+				int j = std::max(lineOrder[p], lineOrder[q]);
+
 				// 'parallel' line segments must not intersect
-				ExtendedPeak ep(lines[i], lineSegments[i], lines[j], lineSegments[j]);
+				ExtendedPeak ep(i, j, lines, lineSegments);
 				if (ep.intersectionPoint.first) {
 					std::vector<cv::Point2f> epHull;
 					cv::convexHull(std::vector<cv::Point2f> {lineSegments[i].p1, lineSegments[i].p2, lineSegments[j].p1, lineSegments[j].p2}, epHull);
@@ -481,60 +927,144 @@ void PageExtractor::findPage(cv::Mat img, float scale, std::vector<DkPolyRect>&
 			}
 		}
 	}
-	
-	// iterate through pairs of EPs and combine them to intermediate peak pairs (IPs) if they form a rectangular shape 
-	std::vector<IntermediatePeak> IPs;
-	for (size_t i = 0; i < EPs.size(); i++) {
-		for (size_t j = i + 1; j < EPs.size(); j++) {
-			// test for orthogonality
-			if (abs(angleDiff(EPs[i].theta_k, EPs[j].theta_k) - (CV_PI * 0.5)) < orthoTol) {
-				IPs.push_back(IntermediatePeak {EPs[i], EPs[j]});
-			}
-		}
+
+	if (EPs.empty()) {
+		qDebug() << "no extended peaks found";
+		return;
 	}
-	
-	// test IP corners
-	std::vector<Rectangle> candidates;
-	for (const IntermediatePeak& ip : IPs) {
-		std::vector<cv::Point2f> corners;
-		for (int i = 0; i < 2; i++) {
-			for (int j = 0; j < 2; j++) {
-				auto r = findLineIntersection(ip.ep1.spatialLines[i], ip.ep2.spatialLines[j]);
-				// since the lines of different EPs can not be parallel, they have to intersect at some point
-				if (r.first != true) {
-					qDebug() << "no intersection was found for two lines that should not be parallel";
-					return;
+
+	// EPs are visited with descending accumulator values: rank[e] is the position of EP e in that order
+	std::vector<int> accOrder(EPs.size());
+	for (int i = 0; i < (int)EPs.size(); i++)
+		accOrder[i] = i;
+	std::sort(accOrder.begin(), accOrder.end(), [&EPs] (int a, int b) { return EPs[a].A_k > EPs[b].A_k; });
+
+	std::vector<int> rank(EPs.size());
+	for (int i = 0; i < (int)accOrder.size(); i++)
+		rank[accOrder[i]] = i;
+
+	// EPs sorted by their mean angle for the orthogonality window search
+	std::vector<int> thetaOrder(accOrder);
+	std::sort(thetaOrder.begin(), thetaOrder.end(), [&EPs] (int a, int b) { return EPs[a].theta_k < EPs[b].theta_k; });
+	std::vector<double> thetas(thetaOrder.size());
+	for (int i = 0; i < (int)thetaOrder.size(); i++)
+		thetas[i] = EPs[thetaOrder[i]].theta_k;
+
+	// the best numFinalRects rectangles are kept in a min-heap (lowest score on top)
+	auto heapComp = [] (const Rectangle& a, const Rectangle& b) { return a.score > b.score; };
+	std::vector<Rectangle> rectangles;
+	const float minSideLength = minRelSideLength * smallerSide;
+
+	// combine pairs of EPs to intermediate peak pairs (IPs) if they form a rectangular shape 
+	for (int r = 0; r < (int)accOrder.size(); r++) {
+		const int i = accOrder[r];
+		const ExtendedPeak& epi = EPs[i];
+
+		// partners have a lower rank, so their accumulator is bounded by ours
+		if ((int)rectangles.size() >= numFinalRects && 2.0 * epi.A_k <= rectangles.front().score)
+			break;
+
+		// orthogonal EPs have a mean angle within [target - orthoTol, target + orthoTol]
+		double target = epi.theta_k + CV_PI * 0.5;
+		if (target >= CV_PI)
+			target -= CV_PI;
+
+		// the window is split in two if it wraps around at 0 or pi
+		double windows[2][2] = { { target - orthoTol, target + orthoTol }, { 0.0, 0.0 } };
+		int numWindows = 1;
+		if (windows[0][0] < 0) {
+			windows[1][0] = windows[0][0] + CV_PI;
+			windows[1][1] = CV_PI;
+			windows[0][0] = 0;
+			numWindows = 2;
+		}
+		else if (windows[0][1] > CV_PI) {
+			windows[1][0] = 0;
+			windows[1][1] = windows[0][1] - CV_PI;
+			windows[0][1] = CV_PI;
+			numWindows = 2;
+		}
+
+		for (int wIdx = 0; wIdx < numWindows; wIdx++) {
+
+			const double* w = windows[wIdx];
+			auto begin = std::lower_bound(thetas.begin(), thetas.end(), w[0]);
+			auto end = std::upper_bound(thetas.begin(), thetas.end(), w[1]);
+
+			for (auto it = begin; it < end; it++) {
+
+				const int j = thetaOrder[it - thetas.begin()];
+
+				// each pair is visited once, from the EP with the higher accumulator
+				if (rank[j] <= r)
+					continue;
+
+				const ExtendedPeak& epj = EPs[j];
+
+				// test for orthogonality
+				if (abs(angleDiff(epi.theta_k, epj.theta_k) - (CV_PI * 0.5)) >= orthoTol)
+					continue;
+
+				Rectangle c(IntermediatePeak(std::min(i, j), std::max(i, j)), epi.A_k + epj.A_k);
+
+				// drop candidates that would not make it into the heap anyway
+				if ((int)rectangles.size() >= numFinalRects && c.score <= rectangles.front().score)
+					continue;
+
+				const ExtendedPeak& ep1 = EPs[c.ip.ep1];
+				const ExtendedPeak& ep2 = EPs[c.ip.ep2];
+				const LineSegment* ep1Lines[2] = { &lineSegments[ep1.line1], &lineSegments[ep1.line2] };
+				const LineSegment* ep2Lines[2] = { &lineSegments[ep2.line1], &lineSegments[ep2.line2] };
+
+				// test IP corners
+				std::vector<cv::Point2f> corners;
+				corners.reserve(4);
+				for (int ci = 0; ci < 2; ci++) {
+					for (int cj = 0; cj < 2; cj++) {
+						auto is = findLineIntersection(*ep1Lines[ci], *ep2Lines[cj]);
+						// since the lines of different EPs can not be parallel, they have to intersect at some point
+						if (is.first != true) {
+							qDebug() << "no intersection was found for two lines that should not be parallel";
+							return;
+						}
+						cv::Point2f pt = is.second;
+						if (pointToLineDistance(*ep1Lines[ci], pt) < cornerGapTol &&
+								pointToLineDistance(*ep2Lines[cj], pt) < cornerGapTol) {
+
+							corners.push_back(pt);
+						}
+					}
+				}
+
+				if (corners.size() != 4)
+					continue;
+
+				std::vector<cv::Point2f> rectCorners;
+				cv::convexHull(corners, rectCorners);
+				if (rectCorners.size() != 4)
+					continue;
+
+				// check if sides are large enough
+				bool largeEnough = true;
+				for (int ci = 0; ci < 4; ci++) {
+					c.corners[ci] = rectCorners[ci];
+					if (cv::norm(rectCorners[ci] - rectCorners[(ci + 1) % 4]) < minSideLength) {
+						largeEnough = false;
+					}
 				}
-				cv::Point2f p = r.second;
-				if (pointToLineDistance(ip.ep1.spatialLines[i], p) < cornerGapTol &&
-						pointToLineDistance(ip.ep2.spatialLines[j], p) < cornerGapTol) {
-					
-					corners.push_back(p);
+				if (!largeEnough) {
+					continue;
+				}
+
+				rectangles.push_back(c);
+				std::push_heap(rectangles.begin(), rectangles.end(), heapComp);
+
+				if ((int)rectangles.size() > numFinalRects) {
+					std::pop_heap(rectangles.begin(), rectangles.end(), heapComp);
+					rectangles.pop_back();
 				}
 			}
 		}
-		
-		std::vector<cv::Point2f> rectCorners;
-		if (corners.size() == 4) {
-			cv::convexHull(corners, rectCorners);
-			candidates.emplace_back(ip, rectCorners);
-		}		
-	}
-	
-	// check rectangle candidates for validity
-	std::vector<Rectangle> rectangles;
-	for (const Rectangle& c : candidates) {
-		// check if sides are large enough
-		bool largeEnough = true;
-		for (int i = 0; i < 4; i++) {
-			if (cv::norm(c.corners[i] - c.corners[(i + 1) % 4]) < minRelSideLength * smallerSide) {
-				largeEnough = false;
-			}
-		}
-		if (!largeEnough) {
-			continue;
-		}
-		rectangles.push_back(c);
 	}
 	
 	if (rectangles.empty()) {
@@ -543,17 +1073,10 @@ void PageExtractor::findPage(cv::Mat img, float scale, std::vector<DkPolyRect>&
 	}
 
 	// sort rectangles by overall accumulator value in descending order
-	std::sort(rectangles.begin(), rectangles.end(), [] (const Rectangle& a, const Rectangle& b) { 
-		return (a.ip.ep1.line1.acc + a.ip.ep1.line2.acc + a.ip.ep2.line1.acc + a.ip.ep2.line2.acc) > // descending
-			(b.ip.ep1.line1.acc + b.ip.ep1.line2.acc + b.ip.ep2.line1.acc + b.ip.ep2.line2.acc);
-	});
-	
-	if (rectangles.size() > numFinalRects) {
-		rectangles.erase(rectangles.begin() + numFinalRects, rectangles.end());
-	}
+	std::sort_heap(rectangles.begin(), rectangles.end(), heapComp);
 
 	// construct DkPolyRects for the rectangles to be returned
-	for (Rectangle rect : rectangles) {
+	for (const Rectangle& rect : rectangles) {
 		std::vector<cv::Point> cornerPoints;
 		for (int i = 0; i < 4; i++) {
 			cornerPoints.emplace_back((int) round(rect.corners[i].x), (int) round(rect.corners[i].y));
@@ -564,28 +1087,27 @@ void PageExtractor::findPage(cv::Mat img, float scale, std::vector<DkPolyRect>&
 	}
 }
 
-float PageExtractor::pointToLineDistance(LineSegment ls, cv::Point2f p) {
-	return (float)(cv::Mat(p - ls.p1).dot(cv::Mat(p - ls.p2)) / std::pow(cv::norm(ls.p2 - ls.p1), 2));
+float PageExtractor::pointToLineDistance(const LineSegment& ls, const cv::Point2f& p) {
+	cv::Point2d d1 = p - ls.p1;
+	cv::Point2d d2 = p - ls.p2;
+	cv::Point2d l = ls.p2 - ls.p1;
+	return (float)(d1.dot(d2) / l.dot(l));
 }
 
 /**
  * Hough transform, similar to the OpenCV implementation, returns a vector of the linesMax lines, sorted by accumulator value in descending order. 
  */
-std::vector<PageExtractor::HoughLine> PageExtractor::houghTransform(cv::Mat bwImg, float rho, float theta, int threshold, int linesMax) const {
+std::vector<PageExtractor::HoughLine> PageExtractor::houghTransform(const DkBitImage& bwImg, float rho, float theta, int threshold, int linesMax, DkPageWorkspace& ws) const {
 	// the implementation is very similar to the one from opencv 2, but it returns the accumulator values and uses some different data structures
 
-	if (bwImg.type() != CV_8U) {
-		qDebug() << "custom houghTransform only supports CV_8U input images";
-		return std::vector<PageExtractor::HoughLine>();
-	}
-	
-	int width = bwImg.cols;
-	int height = bwImg.rows;
+	int width = bwImg.cols();
+	int height = bwImg.rows();
 	std::vector<HoughLine> lines;
 
 	int numAngle = cvRound(CV_PI / theta) + 2;
 	int numRho = (width + height) * 2 + 2; // always even
-	cv::Mat accum = cv::Mat::zeros(numRho, numAngle, CV_16U);
+	cv::Mat accum = ws.mat(DkPageWorkspace::buf_accum, cv::Size(numAngle, numRho), CV_16U);
+	accum.setTo(0);
 	std::vector<double> tabSin(numAngle - 2);
 	std::vector<double> tabCos(numAngle - 2);
 	
@@ -595,10 +1117,17 @@ std::vector<PageExtractor::HoughLine> PageExtractor::houghTransform(cv::Mat bwIm
 		tabCos[n] = cos(static_cast<double>(angle));
 	}
 	
-	// fill the accumulator
+	// fill the accumulator - only the set bits are visited
 	for (int i = 0; i < height; i++) {
-		for (int j = 0; j < width; j++) {
-			if (bwImg.at<unsigned char>(i, j) != 0) {
+
+		const std::uint64_t* bPtr = bwImg.row(i);
+
+		for (int w = 0; w < bwImg.wordsPerRow(); w++) {
+
+			for (std::uint64_t bits = bPtr[w]; bits; bits &= bits - 1) {
+
+				int j = w * 64 + DkBitImage::lowestSetBit(bits);
+
 				for (int n = 0; n < numAngle - 2; n++) {
 					int r = cvRound((j * tabCos[n] + i * tabSin[n]) / rho) + numRho / 2;
 					accum.at<std::uint16_t>(r + 1, n + 1)++;
@@ -644,123 +1173,124 @@ double PageExtractor::angleDiff(double a, double b) {
 
 /**
  * Finds the corresponding line segments (the largest ones) to all houghLines in the binary image bwImg.
+ * The returned vector is aligned with houghLines, lines without a segment have a length of 0.
  * @param bwImg the binary image on which the hough transform was performed
  * @param houghLines vector of hough lines
  * @param minLength the minimum line length
  * @param maxGap the tolerance for gaps in the line segments
  */
-std::vector<PageExtractor::LineSegment> PageExtractor::findLineSegments(cv::Mat bwImg, const std::vector<HoughLine>& houghLines, int minLength, int maxGap) const {
-	std::vector<LineSegment> lineSegments; // final line segments
-	std::vector<LineSegment> lineSegmentsCurrent; // line segments per line
-	LineFindingMode mode;
-	int dimRange = 0;
+std::vector<PageExtractor::LineSegment> PageExtractor::findLineSegments(const DkBitImage& bwImg, const std::vector<HoughLine>& houghLines, int minLength, int maxGap) const {
+	
+	std::vector<LineSegment> lineSegments(houghLines.size());
+
+	cv::parallel_for_(cv::Range(0, (int)houghLines.size()), [&](const cv::Range& range) {
+		for (int idx = range.start; idx < range.end; idx++)
+			lineSegments[idx] = findLongestLineSegment(bwImg, houghLines[idx], minLength, maxGap);
+	});
 	
-	for (HoughLine line : houghLines) {
-		lineSegmentsCurrent.clear();
-		cv::Point2f startPos;
-		bool active = false; // if true: a line is being followed
-		bool inGap = false; // if true: a line is being followed and currently not interrupted
-		cv::Point2f stopPos;
-		cv::Point2f prevPos;
-		int gapCounter = 0;
-		bool notYetInImageRange = true;
-		
-		// in vertical mode, the x values are calculated for every y
-		if (abs(line.angle - CV_PI / 2) > CV_PI / 4) {
-			mode = LineFindingMode::Vertical;
-			dimRange = bwImg.size().height;
-		} else { // in horizontal mode, the y values are calculated for every x
-			mode = LineFindingMode::Horizontal;
-			dimRange = bwImg.size().width;
+	return lineSegments;
+}
+
+/**
+ * Follows a hough line through bwImg and returns its longest line segment (including gaps).
+ * If no segment longer than minLength is found, the returned segment has a length of 0.
+ */
+PageExtractor::LineSegment PageExtractor::findLongestLineSegment(const DkBitImage& bwImg, const HoughLine& line, int minLength, int maxGap) {
+
+	LineSegment longest = { cv::Point2f(), cv::Point2f(), 0.0f };
+	cv::Point2f startPos;
+	bool active = false; // if true: a line is being followed
+	bool inGap = false; // if true: a line is being followed and currently not interrupted
+	cv::Point2f stopPos;
+	cv::Point2f prevPos;
+	int gapCounter = 0;
+	bool notYetInImageRange = true;
+
+	auto addSegment = [&](const cv::Point2f& p1, const cv::Point2f& p2) {
+		float length = (float)cv::norm(p1 - p2);
+		if (length > minLength && length > longest.length)
+			longest = LineSegment {p1, p2, length};
+	};
+
+	// in vertical mode, the x values are calculated for every y
+	// in horizontal mode, the y values are calculated for every x
+	const bool vertical = abs(line.angle - CV_PI / 2) > CV_PI / 4;
+	const int dimRange = vertical ? bwImg.rows() : bwImg.cols();
+	const double sinA = sin((double)line.angle);
+	const double cosA = cos((double)line.angle);
+
+	// the dependent coordinate is c0 + i * dc
+	const double c0 = vertical ? line.rho / cosA : line.rho / sinA;
+	const double dc = vertical ? -sinA / cosA : -cosA / sinA;
+
+	const float maxX = (float)(bwImg.cols() - 1);
+	const float maxY = (float)(bwImg.rows() - 1);
+
+	float x;
+	float y;
+	// go through all x or y values and calculate the corresponding coordinate
+	for (int i = 0; i < dimRange; i++) {
+
+		float c = (float)(c0 + i * dc);
+		x = vertical ? c : (float)i;
+		y = vertical ? (float)i : c;
+
+		if (notYetInImageRange && c >= 0 && c <= (vertical ? maxX : maxY)) {
+			notYetInImageRange = false;
 		}
-		
-		float x;
-		float y;
-		// go through all x or y values and calculate the corresponding coordinate
-		for (int i = 0; i < dimRange; i++) {
-			if (mode == LineFindingMode::Horizontal) {
-				x = (float)i;
-				y = (line.rho - x * cos(line.angle)) / (sin(line.angle));
-				if (notYetInImageRange && y <= bwImg.rows - 1 && y >= 0) {
-					notYetInImageRange = false;
-				}
-			} else {
-				y = (float)i;;
-				x = (line.rho - y * sin(line.angle)) / (cos(line.angle));
-				if (notYetInImageRange && x <= bwImg.cols - 1 && x >= 0) {
-					notYetInImageRange = false;
-				}
+		if (notYetInImageRange) {
+			continue;
+		}
+
+		// close open lines at the end
+		if (i == dimRange - 1 || x > maxX || x < 0 || y > maxY || y < 0) {
+			if (active) {
+				addSegment(startPos, inGap ? stopPos : cv::Point2f(x, y));
 			}
-			if (notYetInImageRange) {
-				continue;
+			break;
+		}
+
+		// test if (x, y) is an edge pixel. account for small errors by checking all possible positions
+		const int xf = (int)x;
+		const int xc = (int)ceil(x);
+		const std::uint64_t* rowF = bwImg.row((int)y);
+		const std::uint64_t* rowC = bwImg.row((int)ceil(y));
+
+		if (DkBitImage::test(rowF, xf) || DkBitImage::test(rowF, xc) || DkBitImage::test(rowC, xf) || DkBitImage::test(rowC, xc)) {
+
+			if (!active) {
+				startPos = cv::Point2f(x, y);
+				active = true;
 			}
-			
-			// close open lines at the end
-			if (i == dimRange - 1 || x > bwImg.cols - 1 || x < 0 || y > bwImg.rows - 1 || y < 0) {
-				if (active) {
-					LineSegment l;
-					if (!inGap) {
-						l.p1 = startPos;
-						l.p2 = cv::Point2f(x, y);
-					} else {
-						l.p1 = startPos;
-						l.p2 = stopPos;
-					}
-					
-					l.length = (float)cv::norm(l.p1 - l.p2);
-					if (l.length > minLength) {
-						lineSegmentsCurrent.push_back(l);
-					}
-				}
-				break;
+			inGap = false;
+		} else { // position is not an edge pixel
+			// assume that the line segment is just interrupted (we are in a gap)
+			if (!inGap) {
+				gapCounter = 0;
+				inGap = true;
+				stopPos = prevPos;
 			}
-			
-			// test if (x, y) is an edge pixel. account for small errors by checking all possible positions
-			if (bwImg.at<unsigned char>((int) ceil(y), (int) ceil(x)) != 0 ||
-					bwImg.at<unsigned char>((int) ceil(y), (int) floor(x)) != 0 || 
-					bwImg.at<unsigned char>((int) floor(y), (int) ceil(x)) != 0 ||
-					bwImg.at<unsigned char>((int) floor(y), (int) floor(x)) != 0) {
-				
-				if (!active) {
-					startPos = cv::Point2f(x, y);
-					active = true;
-				}
-				inGap = false;
-			} else { // position is not an edge pixel
-				// assume that the line segment is just interrupted (we are in a gap)
-				if (!inGap) {
-					gapCounter = 0;
-					inGap = true;
-					stopPos = prevPos;
-				}
-				gapCounter++;
-				// if the gap is too large, the line segment gets closed
-				if (gapCounter >= maxGap && active) {
-					if (cv::norm(stopPos - startPos) > minLength) {
-						lineSegmentsCurrent.push_back(LineSegment {startPos, stopPos, static_cast<float>(cv::norm(stopPos - startPos))});
-					}
-					active = false;
-				}
+			gapCounter++;
+			// if the gap is too large, the line segment gets closed
+			if (gapCounter >= maxGap && active) {
+				addSegment(startPos, stopPos);
+				active = false;
 			}
-			prevPos = cv::Point2f(x, y);
-		}
-		
-		// for every line in houghLines add only the longest line (including gaps) that was found in the image
-		if (!lineSegmentsCurrent.empty()) {
-			auto longestLineSegmentIt = std::max_element(lineSegmentsCurrent.begin(), lineSegmentsCurrent.end(), [] (LineSegment l1, LineSegment l2) { return l1.length < l2.length; });
-			lineSegments.push_back(*longestLineSegmentIt);
 		}
+		prevPos = cv::Point2f(x, y);
 	}
-	
-	return lineSegments;
+
+	return longest;
 }
 
-PageExtractor::ExtendedPeak::ExtendedPeak(const HoughLine& line1, const LineSegment& ls1, const HoughLine& line2, const LineSegment& ls2)
-		: line1(line1), 
-		line2(line2), 
-		spatialLines(std::vector<LineSegment> {ls1, ls2}),
-		intersectionPoint(findLineIntersection(ls1, ls2)) {
+PageExtractor::ExtendedPeak::ExtendedPeak(int l1, int l2, const std::vector<HoughLine>& lines, const std::vector<LineSegment>& lineSegments)
+		: line1(l1), 
+		line2(l2), 
+		intersectionPoint(findLineIntersection(lineSegments[l1], lineSegments[l2])) {
 	
+	const HoughLine& line1 = lines[l1];
+	const HoughLine& line2 = lines[l2];
+
 	// store mean angle
 	if (abs(line1.angle - line2.angle) > CV_PI * 0.5) { // if angle difference is large enough, the angles become closer to each other 
 		// note: lines are always in [0, pi]
@@ -791,71 +1321,130 @@ std::pair<bool, cv::Point2f> PageExtractor::findLineIntersection(const LineSegme
 	return std::pair<bool, cv::Point2f>(r, cv::Point2f(x));
 }
 
+/**
+ * Quantizes the gradient direction atan2(dx, dy) into one of 8 octants without calling atan2.
+ * The octants are half-open [i*pi/4, (i+1)*pi/4) intervals, a and b are the sobel_h and sobel_v responses.
+ */
+static inline int gradientOctant(int a, int b) {
+
+	if (b > 0 || (b == 0 && a > 0)) {	// [0, pi)
+		if (a > 0)
+			return (b >= a) ? 1 : 0;
+		else
+			return (b > -a) ? 2 : 3;
+	}
+	else {								// [pi, 2pi)
+		if (a < 0)
+			return (b <= a) ? 5 : 4;
+		else
+			return (-b > a) ? 6 : 7;
+	}
+}
+
 /**
  * Generates an edge image of gray, tries to remove small text-like structures and returns it.
+ * Every edge pixel is set in the bit-plane of its gradient direction (octant).
+ * The dilated planes are counted bit-sliced (64 pixels at once) and a pixel is considered
+ * to be text if the dilated planes of more than threshold directions overlap.
+ * The returned image is owned by ws.
  */
-cv::Mat PageExtractor::removeText(cv::Mat gray, float sigma, int selemSize, int threshold) {
+const DkBitImage& PageExtractor::removeText(cv::Mat gray, float sigma, int selemSize, int threshold, DkPageWorkspace& ws) {
 	
+	DkBitImage& text = ws.text;
+	text.create(gray.rows, gray.cols);
+
 	if (gray.type() != CV_8U) {
 		qDebug() << "removeText only supports CV_8U format";
-		return gray;
+		return text;
 	}
 	
-	static const float eps = 0.001f;
-	cv::Mat bw;
-	cv::Mat sobel_h;
-	cv::Mat sobel_v;
-	cv::Mat sobel_angle = cv::Mat::zeros(gray.size(), CV_32F);
+	cv::Mat bw = ws.mat(DkPageWorkspace::buf_edges, gray.size(), CV_8UC1);
+	cv::Mat sobel_h = ws.mat(DkPageWorkspace::buf_sobel_h, gray.size(), CV_16SC1);
+	cv::Mat sobel_v = ws.mat(DkPageWorkspace::buf_sobel_v, gray.size(), CV_16SC1);
 	cv::GaussianBlur(gray, gray, cv::Size((int)(2 * floor(sigma * 3) + 1), (int)(2 * floor(sigma * 3) + 1)), sigma);
 	cv::Canny(gray, bw, 0.1 * 255, 0.2 * 255);
-	cv::Sobel(gray, sobel_h, CV_32F, 0, 1, 3);
-	cv::Sobel(gray, sobel_v, CV_32F, 1, 0, 3);
+	cv::Sobel(gray, sobel_h, CV_16S, 0, 1, 3);	// 3x3 sobel responses of 8 bit images fit into 16 bit
+	cv::Sobel(gray, sobel_v, CV_16S, 1, 0, 3);
 	
-	for (int i = 0; i < sobel_angle.rows; i++) {
-		for (int j = 0; j < sobel_angle.cols; j++) {
-			// calculate gradient angle
-			float angle = (atan2(sobel_v.at<float>(i, j), sobel_h.at<float>(i, j)));
-			// shift [-pi, 0] to [pi, 2pi]
-			if (angle < 0.0f) {
-				angle += (float)(2.0f * CV_PI);
+	// edge plane decomposition: every edge pixel is set in the plane of its gradient octant
+	DkBitImage* planes = ws.planes;
+	DkBitImage& edges = ws.edges;
+	for (int i = 0; i < 8; i++)
+		planes[i].create(gray.rows, gray.cols);
+	edges.create(gray.rows, gray.cols);
+
+	cv::parallel_for_(cv::Range(0, gray.rows), [&](const cv::Range& range) {
+
+		for (int rIdx = range.start; rIdx < range.end; rIdx++) {
+
+			const unsigned char* bwPtr = bw.ptr<unsigned char>(rIdx);
+			const short* hPtr = sobel_h.ptr<short>(rIdx);
+			const short* vPtr = sobel_v.ptr<short>(rIdx);
+			std::uint64_t* ePtr = edges.row(rIdx);
+
+			for (int cIdx = 0; cIdx < gray.cols; cIdx++) {
+
+				if (!bwPtr[cIdx] || (!hPtr[cIdx] && !vPtr[cIdx]))
+					continue;
+
+				DkBitImage::set(planes[gradientOctant(hPtr[cIdx], vPtr[cIdx])].row(rIdx), cIdx);
+				DkBitImage::set(ePtr, cIdx);
 			}
-			// set 2pi to 0
-			if (angle >= 2 * CV_PI) {
-				angle = 0.0f;
+		}
+	});
+
+	// remove text regions: keep edge pixels where at most threshold directions overlap
+	// the planes are dilated row by row and summed up in a 4 bit counter (c0..c3) per pixel
+	const std::vector<DkBitImage::Run> seRuns = DkBitImage::runs(cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * selemSize, 2 * selemSize)));
+	const int numWords = text.wordsPerRow();
+
+	cv::parallel_for_(cv::Range(0, gray.rows), [&](const cv::Range& range) {
+
+		std::vector<std::uint64_t> buffer(numWords * 6);
+		std::uint64_t* dilated = buffer.data();
+		std::uint64_t* tmp = dilated + numWords;
+		std::uint64_t* c[4] = { tmp + numWords, tmp + 2 * numWords, tmp + 3 * numWords, tmp + 4 * numWords };
+
+		for (int rIdx = range.start; rIdx < range.end; rIdx++) {
+
+			std::fill(c[0], c[0] + 4 * numWords, std::uint64_t(0));
+
+			for (int i = 0; i < 8; i++) {
+
+				planes[i].dilateRow(seRuns, rIdx, dilated, tmp);
+
+				// bit-sliced increment
+				for (int w = 0; w < numWords; w++) {
+
+					std::uint64_t carry = dilated[w];
+					for (int b = 0; b < 4 && carry; b++) {
+						std::uint64_t next = c[b][w] & carry;
+						c[b][w] ^= carry;
+						carry = next;
+					}
+				}
+			}
+
+			const std::uint64_t* ePtr = edges.row(rIdx);
+			std::uint64_t* tPtr = text.row(rIdx);
+
+			for (int w = 0; w < numWords; w++) {
+
+				// or of (count == k) for all k <= threshold
+				std::uint64_t keep = 0;
+				for (int k = 0; k <= std::min(threshold, 8); k++) {
+					keep |= ((k & 1) ? c[0][w] : ~c[0][w]) &
+						((k & 2) ? c[1][w] : ~c[1][w]) &
+						((k & 4) ? c[2][w] : ~c[2][w]) &
+						((k & 8) ? c[3][w] : ~c[3][w]);
+				}
+
+				tPtr[w] = ePtr[w] & keep;
 			}
-			sobel_angle.at<float>(i, j) = angle;
 		}
-	}
-	
-	// edge plane decomposition
-	
-	std::vector<cv::Mat> E_i(8);
-	std::vector<cv::Mat> E_i_ex(8);
-	cv::Mat H = cv::Mat::zeros(gray.size(), CV_8U);
-	cv::Mat mask;
-	cv::Mat mask_factor = (cv::abs(sobel_h) > eps | cv::abs(sobel_v) > eps);
-	cv::Mat M_text_inv;
-	float rangeStart;
-	float rangeEnd;
-	// go through angles in pi/4 steps
-	for (int i = 0; i < 8; i++) {
-		rangeStart = (float)(CV_PI / 4.0f * i);
-		rangeEnd = (float)(CV_PI / 4.0f * (i + 1));
-		mask = ((sobel_angle >= rangeStart) & (sobel_angle < rangeEnd)) & mask_factor;
-		E_i[i] = mask & bw;
-		cv::dilate(E_i[i], E_i_ex[i], cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2 * selemSize, 2 * selemSize)));
-		cv::threshold(E_i_ex[i], E_i_ex[i], 1, 1, cv::THRESH_TRUNC); // E_i_ex is binary, true pixels are 255, we have to truncate them to 1
-		H += E_i_ex[i];
-	}
-	
-	// remove text regions
-	M_text_inv = H <= threshold;
-	cv::Mat E_i_hat = cv::Mat::zeros(bw.size(), CV_8U);
-	for (int i = 0; i < 8; i++) {
-		E_i_hat = E_i_hat | (E_i[i] & M_text_inv); // equals (E_i[i] AND M_text) XOR E_i[i]
-	}
+	});
 	
-	return E_i_hat;
+	return text;
 }
 
 };
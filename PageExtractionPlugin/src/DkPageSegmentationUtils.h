@@ -29,7 +29,14 @@
 #pragma warning(push, 0)	// no warnings from includes - begin
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc_c.h>
+#include <QSettings>
 #include <QString>
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #pragma warning(pop)		// no warnings from includes - end
 
 namespace nmp {
@@ -397,7 +404,7 @@ class DkIntersectPoly {
 public:
 
 	DkIntersectPoly();
-	DkIntersectPoly(std::vector<nmc::DkVector> vecA, std::vector<nmc::DkVector> vecB);
+	DkIntersectPoly(const std::vector<nmc::DkVector>& vecA, const std::vector<nmc::DkVector>& vecB);
 
 	double compute();
 
@@ -411,13 +418,13 @@ private:
 	nmc::DkVector scale;
 	float gamut;
 
-	void inness(std::vector<DkVertex> ipA, std::vector<DkVertex> ipB);
-	void cross(DkVertex a, DkVertex b, DkVertex c, DkVertex d, double a1, double a2, double a3, double a4);
+	void inness(const std::vector<DkVertex>& ipA, const std::vector<DkVertex>& ipB);
+	void cross(const DkVertex& a, const DkVertex& b, const DkVertex& c, const DkVertex& d, double a1, double a2, double a3, double a4);
 	void cntrib(int fx, int fy, int tx, int ty, int w);
 	int64 area(DkIPoint a, DkIPoint p, DkIPoint q);
 	bool ovl(DkIPoint p, DkIPoint q);
 	void getVertices(const std::vector<nmc::DkVector>& vec, std::vector<DkVertex> *ip, int noise);
-	void computeBoundingBox(std::vector<nmc::DkVector> vec, nmc::DkVector *minRange, nmc::DkVector *maxRange);
+	void computeBoundingBox(const std::vector<nmc::DkVector>& vec, nmc::DkVector *minRange, nmc::DkVector *maxRange);
 };
 
 // data class
@@ -455,24 +462,145 @@ protected:
 	void computeMaxCosine();
 };
 
+/**
+ * Binary image with 64 pixels packed into one word.
+ * Bit b of word w in a row is the pixel at column 64*w + b, bits beyond cols are always 0.
+ * Morphology works with shifts and ors on whole words, so binary stages move 1/8 of the
+ * memory of a CV_8U mask.
+ **/
+class DkBitImage {
+
+public:
+	DkBitImage() {}
+
+	// horizontal run [l, r] of a structuring element in row dy (relative to its anchor)
+	struct Run {
+		int dy;
+		int l;
+		int r;
+	};
+
+	void create(int rows, int cols);
+	void toMat(cv::Mat& img) const;
+
+	int rows() const { return mRows; };
+	int cols() const { return mCols; };
+	int wordsPerRow() const { return mWords; };
+	bool empty() const { return mRows == 0 || mCols == 0; };
+	size_t bytes() const { return mBits.capacity() * sizeof(std::uint64_t); };
+
+	std::uint64_t* row(int r) { return mBits.data() + (size_t)r * mWords; };
+	const std::uint64_t* row(int r) const { return mBits.data() + (size_t)r * mWords; };
+
+	static bool test(const std::uint64_t* row, int c) { return ((row[c >> 6] >> (c & 63)) & 1) != 0; };
+	static void set(std::uint64_t* row, int c) { row[c >> 6] |= std::uint64_t(1) << (c & 63); };
+	bool test(int r, int c) const { return test(row(r), c); };
+
+	static int lowestSetBit(std::uint64_t w);
+
+	static std::vector<Run> runs(const cv::Mat& selem);
+	void dilateRow(const std::vector<Run>& runs, int r, std::uint64_t* dst, std::uint64_t* tmp) const;
+	void dilate(const cv::Mat& selem, DkBitImage& dst) const;
+
+protected:
+	int mRows = 0;
+	int mCols = 0;
+	int mWords = 0;
+	std::vector<std::uint64_t> mBits;
+
+	std::uint64_t tailMask() const;
+};
+
+/**
+ * Returns the index of the lowest set bit of w (w must not be 0).
+ **/
+inline int DkBitImage::lowestSetBit(std::uint64_t w) {
+
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long idx;
+	_BitScanForward64(&idx, w);
+	return (int)idx;
+#elif defined(__GNUC__)
+	return __builtin_ctzll(w);
+#else
+	int idx = 0;
+	while (!(w & 1)) {
+		w >>= 1;
+		idx++;
+	}
+	return idx;
+#endif
+}
+
+/**
+ * Scratch buffers of the page segmentation.
+ * Each thread owns one workspace (see local()) which is reused for all images
+ * processed on that thread. Buffers only grow, so a batch of similar sized images
+ * allocates them once. Views returned by mat() are valid until the same slot is
+ * requested with a larger size.
+ **/
+class DkPageWorkspace {
+
+public:
+	enum Buffer {
+		buf_resized = 0,
+		buf_gray0,
+		buf_gray,
+		buf_luminance,
+		buf_edges,
+		buf_sobel_h,
+		buf_sobel_v,
+		buf_accum,
+
+		buf_end
+	};
+
+	static DkPageWorkspace& local();
+
+	cv::Mat mat(Buffer slot, const cv::Size& size, int type);
+	size_t bytes() const;
+
+	// contour buffers of DkPageSegmentation::findRectangles
+	std::vector<std::vector<cv::Point> > contours;
+	std::vector<std::vector<cv::Point> > hull;
+	std::vector<cv::Point> approx;
+
+	// binary images of PageExtractor::findPage
+	DkBitImage planes[8];
+	DkBitImage edges;
+	DkBitImage text;
+	DkBitImage bw;
+
+protected:
+	DkPageWorkspace() {}
+	DkPageWorkspace(const DkPageWorkspace&) = delete;
+	DkPageWorkspace& operator=(const DkPageWorkspace&) = delete;
+
+	cv::Mat mBuffers[buf_end];
+};
+
 class PageExtractor {
 	
 public:
 	PageExtractor() {}
 	
-	void findPage(cv::Mat img, float scale, std::vector<DkPolyRect>& rects);
+	void findPage(cv::Mat img, float scale, std::vector<DkPolyRect>& rects) const;
+
+	void loadSettings(QSettings& settings);
+	void saveSettings(QSettings& settings) const;
+	QByteArray parameterKey() const;
 	
 protected:
-	const int maxLinesHough = 30;
-	const float houghPeakThresholdRel = 0.3f; // minimum accumulator value of hough lines, relative to smaller image dimension
-	const double t_theta = CV_PI / 9; // angle tolerance for parallel lines
-	const float t_l = 0.5f;
-	const float maxGapLengthRel = 0.3f; // maximum gap size in findLineSegments, relative to smaller image dimension
-	const int minLineSegmentLength = 10;
-	const float minRelSideLength = 0.3f; // minimum length of final rectangle sides relative to smaller image dimension
-	const double orthoTol = CV_PI / 9; // orthogonality tolerance
-	const float cornerGapTol = 3.0f; // tolerance for line segments that almost form a corner
-	const int numFinalRects = 3; // number of rectangles to return
+	int maxLinesHough = 30;
+	float houghPeakThresholdRel = 0.3f; // minimum accumulator value of hough lines, relative to smaller image dimension
+	double t_theta = CV_PI / 9; // angle tolerance for parallel lines
+	float t_l = 0.5f;
+	float maxGapLengthRel = 0.3f; // maximum gap size in findLineSegments, relative to smaller image dimension
+	int minLineSegmentLength = 10;
+	float minRelSideLength = 0.3f; // minimum length of final rectangle sides relative to smaller image dimension
+	double orthoTol = CV_PI / 9; // orthogonality tolerance
+	float cornerGapTol = 3.0f; // tolerance for line segments that almost form a corner
+	int numFinalRects = 3; // number of rectangles to return
 	
 	struct HoughLine {
 		int acc;
@@ -487,39 +615,37 @@ protected:
 	};
 	
 	struct ExtendedPeak {
-		ExtendedPeak(const HoughLine& line1, const LineSegment& ls1, const HoughLine& line2, const LineSegment& ls2);
-		//~ExtendedPeak() {}
+		ExtendedPeak(int l1, int l2, const std::vector<HoughLine>& lines, const std::vector<LineSegment>& lineSegments);
 		
-		HoughLine line1;
-		HoughLine line2;
-		std::vector<LineSegment> spatialLines;
+		int line1;	// index of the hough line and its line segment
+		int line2;
 		std::pair<bool, cv::Point2f> intersectionPoint;
 		double theta_k;
 		double A_k;
 	};
 	
 	struct IntermediatePeak {
-		IntermediatePeak(const ExtendedPeak& ep1, const ExtendedPeak& ep2) : ep1(ep1), ep2(ep2) {}
+		IntermediatePeak(int ep1 = -1, int ep2 = -1) : ep1(ep1), ep2(ep2) {}
 		
-		ExtendedPeak ep1;
-		ExtendedPeak ep2;
+		int ep1;	// index of the extended peaks
+		int ep2;
 	};
 	
 	struct Rectangle {
-		Rectangle(const IntermediatePeak& ip, const std::vector<cv::Point2f>& corners) : ip(ip), corners(corners) {}
+		Rectangle(const IntermediatePeak& ip = IntermediatePeak(), double score = 0.0) : ip(ip), score(score) {}
 		
 		IntermediatePeak ip;
-		std::vector<cv::Point2f> corners;
+		cv::Point2f corners[4];
+		double score;	// sum of the extended peak accumulators
 	};
 	
-	enum class LineFindingMode {Horizontal, Vertical};
-	
 	static double angleDiff(double a, double b);
 	static std::pair<bool, cv::Point2f> findLineIntersection(const LineSegment& ls1, const LineSegment& ls2);
-	static float pointToLineDistance(LineSegment ls, cv::Point2f p);
-	static cv::Mat removeText(cv::Mat gray, float sigma, int selemSize, int threshold = 2);
-	std::vector<HoughLine> houghTransform(cv::Mat bwImg, float rho, float theta, int threshold, int linesMax) const;
-	std::vector<LineSegment> findLineSegments(cv::Mat bwImg, const std::vector<HoughLine>& houghLines, int minLength, int maxGap) const;
+	static float pointToLineDistance(const LineSegment& ls, const cv::Point2f& p);
+	static const DkBitImage& removeText(cv::Mat gray, float sigma, int selemSize, int threshold, DkPageWorkspace& ws);
+	std::vector<HoughLine> houghTransform(const DkBitImage& bwImg, float rho, float theta, int threshold, int linesMax, DkPageWorkspace& ws) const;
+	std::vector<LineSegment> findLineSegments(const DkBitImage& bwImg, const std::vector<HoughLine>& houghLines, int minLength, int maxGap) const;
+	static LineSegment findLongestLineSegment(const DkBitImage& bwImg, const HoughLine& line, int minLength, int maxGap);
 };
 
 };
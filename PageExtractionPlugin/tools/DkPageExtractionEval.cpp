@@ -0,0 +1,296 @@
+/*******************************************************************************************************
+ DkPageExtractionEval.cpp
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2015 Markus Diem
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+// Evaluates and benchmarks the page segmentation on a folder of images with ground truth.
+// usage: pageExtractionEval <folder> [--threads N] [--preset fast] [--gray] [--csv results.csv] [--json summary.json]
+
+#include "DkPageSegmentation.h"
+#include "DkPageEvaluation.h"
+
+#include "DkImageBridge.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+#include <functional>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+struct DkEvalMethod {
+	QString name;
+	bool alternativeMethod;
+};
+
+struct DkEvalResult {
+	QString fileName;
+	QString method;
+	double decodeMs = 0;
+	double computeMs = 0;
+	double filterMs = 0;
+	int numRects = 0;
+	double jaccard = 0;
+};
+
+static double elapsedMs(const QElapsedTimer& dt) {
+	return dt.nsecsElapsed() / 1e6;
+}
+
+/**
+* Decodes one image and runs all methods on it.
+* If gray is true, the methods run a second time on a grayscale copy (reported as <method>-gray).
+**/
+static QVector<DkEvalResult> evaluateImage(const QString& filePath, const QVector<DkEvalMethod>& methods, DkPageSegmentation::Preset preset, bool gray) {
+
+	QVector<DkEvalResult> results;
+
+	QElapsedTimer dt;
+	dt.start();
+	QImage img(filePath);
+
+	if (img.isNull()) {
+		qWarning() << "could not load" << filePath;
+		return results;
+	}
+
+	QVector<DkMatView> views;
+	views << DkMatView(img);
+	double decodeMs = elapsedMs(dt);
+
+	// single channel input (most document scans are grayscale)
+	if (gray)
+		views << DkMatView(img.convertToFormat(QImage::Format_Grayscale8));
+
+	QPolygonF gt = DkPageEvaluation::readGT(filePath);
+
+	for (int vIdx = 0; vIdx < views.size(); vIdx++) {
+
+		for (const DkEvalMethod& m : methods) {
+
+			DkEvalResult r;
+			r.fileName = QFileInfo(filePath).fileName();
+			r.method = vIdx == 0 ? m.name : m.name + "-gray";
+			r.decodeMs = decodeMs;
+
+			DkPageSegmentation segM(views[vIdx].mat(), m.alternativeMethod);
+			segM.setPreset(preset);
+
+			dt.restart();
+			segM.compute();
+			r.computeMs = elapsedMs(dt);
+
+			dt.restart();
+			segM.filterDuplicates();
+			r.filterMs = elapsedMs(dt);
+
+			r.numRects = (int)segM.getRects().size();
+			r.jaccard = DkPageEvaluation::jaccardIndex(gt, segM.getMaxRect().toPolygon());
+
+			results << r;
+		}
+	}
+
+	return results;
+}
+
+static QJsonObject summarize(const QVector<DkEvalResult>& results, const QString& method, double hitThresh) {
+
+	int n = 0, hits = 0;
+	double jaccard = 0, decode = 0, compute = 0, filter = 0;
+
+	for (const DkEvalResult& r : results) {
+
+		if (r.method != method)
+			continue;
+
+		n++;
+		jaccard += r.jaccard;
+		decode += r.decodeMs;
+		compute += r.computeMs;
+		filter += r.filterMs;
+		hits += r.jaccard >= hitThresh;
+	}
+
+	QJsonObject o;
+	o["method"] = method;
+	o["images"] = n;
+
+	if (n > 0) {
+		o["meanJaccard"] = jaccard / n;
+		o["hitRate"] = (double)hits / n;
+		o["meanDecodeMs"] = decode / n;
+		o["meanComputeMs"] = compute / n;
+		o["meanFilterMs"] = filter / n;
+
+		// the methods run interleaved in the pool - so their throughput is derived from their own
+		// stage timings (single thread), the throughput of the whole run is reported in the summary
+		double methodMs = decode + compute + filter;
+		o["imagesPerSecondPerThread"] = methodMs > 0 ? n / (methodMs / 1000.0) : 0.0;
+	}
+
+	return o;
+}
+
+};
+
+int main(int argc, char** argv) {
+
+	using namespace nmp;
+
+	QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName("pageExtractionEval");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Evaluates the page segmentation against ground truth (img.xml next to img.jpg).");
+	parser.addHelpOption();
+	parser.addPositionalArgument("folder", "Folder containing the images and their ground truth.");
+
+	QCommandLineOption threadsOpt("threads", "Number of worker threads (default: ideal thread count).", "N");
+	QCommandLineOption csvOpt("csv", "Writes per image results to <file>.", "file");
+	QCommandLineOption jsonOpt("json", "Writes the summary to <file> (default: stdout).", "file");
+	QCommandLineOption methodOpt("method", "thresholds, bhaskar or all (default).", "name", "all");
+	QCommandLineOption hitOpt("hit", "Jaccard index at which a page counts as found (default: 0.9).", "value", "0.9");
+	QCommandLineOption presetOpt("preset", "default or fast (default: default).", "name", "default");
+	QCommandLineOption grayOpt("gray", "Additionally evaluates a grayscale copy of every image.");
+	parser.addOptions({ threadsOpt, csvOpt, jsonOpt, methodOpt, hitOpt, presetOpt, grayOpt });
+	parser.process(app);
+
+	if (parser.positionalArguments().isEmpty())
+		parser.showHelp(1);
+
+	QVector<DkEvalMethod> methods;
+	QString method = parser.value(methodOpt);
+	if (method == "all" || method == "thresholds")
+		methods << DkEvalMethod{ "thresholds", false };
+	if (method == "all" || method == "bhaskar")
+		methods << DkEvalMethod{ "bhaskar", true };
+
+	if (methods.empty()) {
+		qCritical() << "unknown method:" << method;
+		return 1;
+	}
+
+	DkPageSegmentation::Preset preset = DkPageSegmentation::preset_default;
+	if (parser.value(presetOpt) == "fast")
+		preset = DkPageSegmentation::preset_fast;
+	else if (parser.value(presetOpt) != "default") {
+		qCritical() << "unknown preset:" << parser.value(presetOpt);
+		return 1;
+	}
+
+	if (parser.isSet(threadsOpt))
+		QThreadPool::globalInstance()->setMaxThreadCount(qMax(parser.value(threadsOpt).toInt(), 1));
+
+	// collect all images that have a GT
+	QDir dir(parser.positionalArguments().first());
+	QStringList filePaths;
+	for (const QFileInfo& fi : dir.entryInfoList(QStringList() << "*.jpg" << "*.jpeg" << "*.png" << "*.tif" << "*.tiff", QDir::Files, QDir::Name)) {
+
+		if (QFileInfo(fi.absolutePath(), fi.baseName() + ".xml").exists())
+			filePaths << fi.absoluteFilePath();
+	}
+
+	if (filePaths.empty()) {
+		qCritical() << "no images with ground truth found in" << dir.absolutePath();
+		return 1;
+	}
+
+	qInfo() << "evaluating" << filePaths.size() << "images with" << QThreadPool::globalInstance()->maxThreadCount() << "threads";
+
+	QElapsedTimer wall;
+	wall.start();
+
+	bool gray = parser.isSet(grayOpt);
+	std::function<QVector<DkEvalResult>(const QString&)> evalFunc = [&methods, preset, gray](const QString& fp) { return evaluateImage(fp, methods, preset, gray); };
+	QList<QVector<DkEvalResult> > perImage = QtConcurrent::blockingMapped<QList<QVector<DkEvalResult> > >(filePaths, evalFunc);
+
+	double wallMs = elapsedMs(wall);
+
+	QVector<DkEvalResult> results;
+	for (const QVector<DkEvalResult>& r : perImage)
+		results << r;
+
+	// per image results
+	if (parser.isSet(csvOpt)) {
+
+		QFile file(parser.value(csvOpt));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+			qCritical() << "could not write" << file.fileName();
+			return 1;
+		}
+
+		QTextStream stream(&file);
+		stream << "file,method,jaccard,numRects,decodeMs,computeMs,filterMs\n";
+
+		for (const DkEvalResult& r : results) {
+			stream << r.fileName << "," << r.method << "," << r.jaccard << "," << r.numRects << ","
+				<< r.decodeMs << "," << r.computeMs << "," << r.filterMs << "\n";
+		}
+	}
+
+	// summary
+	QJsonArray summaries;
+	for (const DkEvalMethod& m : methods) {
+		summaries.append(summarize(results, m.name, parser.value(hitOpt).toDouble()));
+
+		if (gray)
+			summaries.append(summarize(results, m.name + "-gray", parser.value(hitOpt).toDouble()));
+	}
+
+	QJsonObject summary;
+	summary["threads"] = QThreadPool::globalInstance()->maxThreadCount();
+	summary["preset"] = parser.value(presetOpt);
+	summary["gray"] = gray;
+	summary["wallMs"] = wallMs;
+	summary["imagesPerSecond"] = wallMs > 0 ? filePaths.size() / (wallMs / 1000.0) : 0.0;	// all methods
+	summary["methods"] = summaries;
+
+	QByteArray json = QJsonDocument(summary).toJson();
+
+	if (parser.isSet(jsonOpt)) {
+
+		QFile file(parser.value(jsonOpt));
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+			qCritical() << "could not write" << file.fileName();
+			return 1;
+		}
+		file.write(json);
+	}
+	else
+		QTextStream(stdout) << json;
+
+	return 0;
+}
@@ -0,0 +1,248 @@
+/*******************************************************************************************************
+ DkImageBridge.cpp
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2015 Markus Diem <markus@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkImageBridge.h"
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QDebug>
+#include <QVector>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+* Returns true if the pixels of img can be used as they are.
+* Indexed images are only used if every index is its own gray value (identity ramp).
+* Other gray palettes (e.g. 4 bit gray PNGs or min-is-white scans) would be misread.
+**/
+static bool isViewable(const QImage& img) {
+
+	if (img.format() == QImage::Format_Indexed8) {
+
+		const QVector<QRgb> colorTable = img.colorTable();
+
+		for (int idx = 0; idx < colorTable.size(); idx++) {
+			if (colorTable[idx] != qRgb(idx, idx, idx))
+				return false;
+		}
+
+		return true;
+	}
+
+	return DkImageBridge::channels(img.format()) > 0;
+}
+
+/**
+* The format img is converted to if it is not viewable.
+**/
+static QImage::Format viewFormat(const QImage& img) {
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	if (img.format() == QImage::Format_Indexed8 && img.allGray())
+		return QImage::Format_Grayscale8;
+#else
+	Q_UNUSED(img);
+#endif
+
+	return QImage::Format_ARGB32;
+}
+
+// DkMatView --------------------------------------------------------------------
+/**
+* Creates a view on img - img is converted to ARGB32 (or Grayscale8 if it has a gray palette)
+* if OpenCV cannot use its pixels directly.
+**/
+DkMatView::DkMatView(const QImage& img) {
+
+	if (img.isNull())
+		return;
+
+	mBorrowed = isViewable(img);
+	mImg = mBorrowed ? img : img.convertToFormat(viewFormat(img));
+
+	// constBits() does not detach - so we share the buffer with img
+	mMat = cv::Mat(mImg.height(), mImg.width(), CV_8UC(DkImageBridge::channels(mImg.format())),
+		const_cast<uchar*>(mImg.constBits()), mImg.bytesPerLine());
+}
+
+/**
+* The view - do not write to it.
+* Use DkImageBridge::writableView if you want to modify the image.
+**/
+const cv::Mat& DkMatView::mat() const {
+	return mMat;
+}
+
+/**
+* The image the view points to (i.e. the converted image if a conversion was needed).
+**/
+QImage DkMatView::image() const {
+	return mImg;
+}
+
+/**
+* Returns true if the view shares the pixels of the image it was created from.
+**/
+bool DkMatView::isBorrowed() const {
+	return mBorrowed;
+}
+
+// DkImageBridge --------------------------------------------------------------------
+/**
+* Returns the number of channels OpenCV sees for format, 0 if the format cannot be used directly.
+**/
+int DkImageBridge::channels(QImage::Format format) {
+
+	switch (format) {
+	case QImage::Format_ARGB32:
+	case QImage::Format_ARGB32_Premultiplied:
+	case QImage::Format_RGB32:
+		return 4;
+	case QImage::Format_RGB888:
+		return 3;
+	case QImage::Format_Indexed8:
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+	case QImage::Format_Grayscale8:
+#endif
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/**
+* Converts a color to a scalar with the memory layout of format.
+* The color is premultiplied if format is ARGB32_Premultiplied.
+**/
+cv::Scalar DkImageBridge::toScalar(const QColor& col, QImage::Format format) {
+
+	switch (channels(format)) {
+	case 3:
+		return cv::Scalar(col.red(), col.green(), col.blue());
+	case 1:
+		return cv::Scalar(qGray(col.rgb()));
+	default: {
+
+		// translucent colors would be invalid pixels otherwise (color > alpha)
+		QRgb rgba = format == QImage::Format_ARGB32_Premultiplied ? qPremultiply(col.rgba()) : col.rgba();
+
+		return cv::Scalar(qBlue(rgba), qGreen(rgba), qRed(rgba), qAlpha(rgba));	// (A)RGB32 is BGRA in memory (little endian)
+	}
+	}
+}
+
+/**
+* Returns a view that writes directly into img.
+* img is detached first (if it is shared) and converted to ARGB32 if OpenCV cannot use its format.
+* Indexed images are kept, the view then contains the color indexes.
+**/
+cv::Mat DkImageBridge::writableView(QImage& img) {
+
+	if (img.isNull())
+		return cv::Mat();
+
+	if (!channels(img.format()))
+		img = img.convertToFormat(QImage::Format_ARGB32);
+
+	return cv::Mat(img.height(), img.width(), CV_8UC(channels(img.format())), img.bits(), img.bytesPerLine());
+}
+
+/**
+* Returns a Mat that owns its pixels.
+* Prefer DkMatView if you only read the pixels - it does not copy them.
+**/
+cv::Mat DkImageBridge::toMat(const QImage& img) {
+
+	return DkMatView(img).mat().clone();
+}
+
+static void releaseMat(void* mat) {
+	delete static_cast<cv::Mat*>(mat);
+}
+
+/**
+* Hands the pixels of mat over to a QImage without copying them.
+* The QImage keeps a reference to mat's buffer and treats it as read-only, i.e.
+* it copies the pixels the first time it is modified (copy-on-write).
+* Pixels are copied if the rows are not 32 bit aligned (as QImage requires) or if mat is not 8 bit.
+* @param mat CV_8UC1 | CV_8UC3 | CV_8UC4 (other depths are scaled to 8 bit, CV_32F is assumed to be in [0 1])
+* @param format the QImage format, it is used if it fits the number of channels of mat
+* @return QImage the image (a null image if mat cannot be converted)
+**/
+QImage DkImageBridge::toQImage(const cv::Mat& mat, QImage::Format format) {
+
+	if (mat.empty())
+		return QImage();
+
+	cv::Mat m = mat;
+
+	if (m.depth() != CV_8U)
+		m.convertTo(m, CV_8U, m.depth() == CV_32F || m.depth() == CV_64F ? 255 : 1);
+
+	if (channels(format) != m.channels()) {
+
+		switch (m.channels()) {
+		case 1:
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+			format = QImage::Format_Grayscale8;
+#else
+			format = QImage::Format_Indexed8;
+#endif
+			break;
+		case 3:
+			format = QImage::Format_RGB888;
+			break;
+		case 4:
+			format = QImage::Format_ARGB32;
+			break;
+		default:
+			qWarning() << "[DkImageBridge] cannot convert a Mat with" << m.channels() << "channels";
+			return QImage();
+		}
+	}
+
+	QImage img;
+
+	// QImage needs 32 bit aligned rows - the const buffer makes the QImage copy-on-write
+	if (m.step % 4 == 0 && (size_t)m.data % 4 == 0) {
+		img = QImage((const uchar*)m.data, m.cols, m.rows, (int)m.step, format, releaseMat, new cv::Mat(m));
+	}
+	else {
+		img = QImage(m.cols, m.rows, format);
+		m.copyTo(cv::Mat(img.height(), img.width(), m.type(), img.bits(), img.bytesPerLine()));
+	}
+
+	if (format == QImage::Format_Indexed8) {
+
+		QVector<QRgb> colorTable(256);
+		for (int idx = 0; idx < colorTable.size(); idx++)
+			colorTable[idx] = qRgb(idx, idx, idx);
+
+		img.setColorTable(colorTable);
+	}
+
+	return img;
+}
+
+};
@@ -0,0 +1,72 @@
+/*******************************************************************************************************
+ DkImageBridge.h
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2015 Markus Diem <markus@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#pragma warning(push, 0)	// no warnings from includes - begin
+#include <QColor>
+#include <QImage>
+
+#include <opencv2/core/core.hpp>
+#pragma warning(pop)		// no warnings from includes - end
+
+namespace nmp {
+
+/**
+* Read-only cv::Mat view on a QImage.
+* The view keeps a shallow copy of the image, so the pixels live as long as the view does.
+* If the image is modified elsewhere, Qt detaches it and the view keeps the original pixels.
+* Formats OpenCV cannot work on directly are converted (copied) once.
+**/
+class DkMatView {
+
+public:
+	DkMatView(const QImage& img = QImage());
+
+	const cv::Mat& mat() const;
+	QImage image() const;
+	bool isBorrowed() const;
+
+protected:
+	QImage mImg;
+	cv::Mat mMat;
+	bool mBorrowed = false;
+};
+
+/**
+* Conversions between QImage and cv::Mat that copy pixels only if the formats require it.
+* (A)RGB32 is BGRA in memory (little endian), RGB888 is RGB.
+**/
+class DkImageBridge {
+
+public:
+	static int channels(QImage::Format format);
+	static cv::Scalar toScalar(const QColor& col, QImage::Format format);
+
+	static cv::Mat writableView(QImage& img);
+	static cv::Mat toMat(const QImage& img);
+	static QImage toQImage(const cv::Mat& mat, QImage::Format format = QImage::Format_Invalid);
+};
+
+};
@@ -221,3 +221,11 @@ macro(NMC_GENERATE_USER_FILE)
 		endif()
 	endif(MSVC)
 endmacro(NMC_GENERATE_USER_FILE)
+
+# adds the shared plugin utilities (PluginUtils) - link your plugin against pluginUtils
+# the library is only built once if several plugins use it
+macro(NMC_ADD_PLUGIN_UTILS)
+	if (NOT TARGET pluginUtils)
+		add_subdirectory(${CMAKE_CURRENT_SOURCE_DIR}/../PluginUtils ${CMAKE_BINARY_DIR}/PluginUtils)
+	endif()
+endmacro(NMC_ADD_PLUGIN_UTILS)